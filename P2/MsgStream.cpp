@@ -7,7 +7,7 @@
 
 using namespace std;
 
-MsgStream::MsgStream(int initialCapacity) : messageCount(0), operationCount(0)
+MsgStream::MsgStream(int initialCapacity) : operationCount(0), messageCount(0)
 {
     capacity = calculateCapacity(initialCapacity);
     maxOperations = calculateMaxOperations(capacity);
@@ -79,7 +79,7 @@ MsgStream& MsgStream::operator=(const MsgStream& other)
 
 MsgStream::MsgStream(MsgStream&& src) noexcept 
     : messages(src.messages), capacity(src.capacity), maxOperations(src.maxOperations), 
-      messageCount(src.messageCount), operationCount(src.operationCount) {
+      operationCount(src.operationCount), messageCount(src.messageCount) {
 
     src.messages = nullptr;
     src.capacity = 0;
@@ -186,7 +186,7 @@ bool MsgStream::operationLimit() const{
 
 bool MsgStream::isValidMessage(const char* message) const
 {
-    return message != nullptr && strlen(message) <= MAX_STRING_LENGTH;
+    return message != nullptr && strlen(message) <= static_cast<size_t>(MAX_STRING_LENGTH);
 }
 
 int MsgStream::calculateCapacity(int cap)
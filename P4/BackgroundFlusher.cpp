@@ -0,0 +1,190 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#include "BackgroundFlusher.h"
+
+#include "SegmentedLog.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+using namespace std;
+
+BackgroundFlusher::BackgroundFlusher(SegmentedLog& log, int batchSize, int milliseconds)
+    : log(log), batchSize(batchSize), milliseconds(milliseconds), ring(new char[QUEUE_BYTES]), head(0), tail(0),
+      enqueued(0), lastWake(0), failed(false), written(0), wakeRequested(false), stopping(false)
+{
+    if (batchSize < 0 || milliseconds < 0)
+        throw invalid_argument("Invalid background flush trigger.");
+
+    worker = thread(&BackgroundFlusher::run, this);
+}
+
+BackgroundFlusher::~BackgroundFlusher()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    work.notify_one();
+    worker.join();
+}
+
+void BackgroundFlusher::enqueue(string_view record)
+{
+    if (record.size() > static_cast<size_t>(SegmentedLog::MAX_RECORD_SIZE))
+        throw invalid_argument("Record exceeds maximum size.");
+
+    size_t required = LENGTH_SIZE + record.size();
+    size_t position = tail.load(memory_order_relaxed);
+    if (QUEUE_BYTES - (position - head.load(memory_order_acquire)) < required)
+    {
+        unique_lock<mutex> guard(lock);
+        wakeRequested = true;
+        work.notify_one();
+        done.wait(guard, [&]() { return failure || QUEUE_BYTES - (position - head.load(memory_order_acquire)) >= required; });
+    }
+
+    if (failed.load(memory_order_acquire))
+    {
+        lock_guard<mutex> guard(lock);
+        rethrow_exception(failure);
+    }
+
+    uint32_t length = static_cast<uint32_t>(record.size());
+    copyIn(position, reinterpret_cast<const char*>(&length), LENGTH_SIZE);
+    copyIn(position + LENGTH_SIZE, record.data(), record.size());
+    tail.store(position + required, memory_order_release);
+    enqueued++;
+
+    if (batchSize > 0 && enqueued - lastWake >= batchSize)
+    {
+        wake();
+    }
+}
+
+void BackgroundFlusher::barrier()
+{
+    unique_lock<mutex> guard(lock);
+    wakeRequested = true;
+    work.notify_one();
+    done.wait(guard, [&]() { return failure || written >= enqueued; });
+    lastWake = enqueued;
+
+    if (failure)
+        rethrow_exception(failure);
+}
+
+void BackgroundFlusher::run()
+{
+    unique_lock<mutex> guard(lock);
+    while (true)
+    {
+        auto due = [&]() { return wakeRequested || stopping; };
+        if (milliseconds > 0)
+        {
+            work.wait_for(guard, chrono::milliseconds(milliseconds), due);
+        }
+        else
+        {
+            work.wait(guard, due);
+        }
+        wakeRequested = false;
+        bool stop = stopping;
+
+        guard.unlock();
+        long long count = 0;
+        exception_ptr error;
+        try
+        {
+            count = drain();
+        }
+        catch (...)
+        {
+            error = current_exception();
+        }
+        guard.lock();
+
+        written += count;
+        if (error)
+        {
+            failure = error;
+            failed.store(true, memory_order_release);
+        }
+        done.notify_all();
+        if (stop || failure)
+            return;
+    }
+}
+
+long long BackgroundFlusher::drain()
+{
+    size_t position = head.load(memory_order_relaxed);
+    size_t end = tail.load(memory_order_acquire);
+    if (position == end)
+        return 0;
+
+    string wrapped;
+    long long count = 0;
+    while (position < end)
+    {
+        uint32_t length;
+        copyOut(position, reinterpret_cast<char*>(&length), LENGTH_SIZE);
+        size_t start = (position + LENGTH_SIZE) % QUEUE_BYTES;
+
+        // Records that wrap around the end of the ring are reassembled; all others are appended in place.
+        if (start + length <= QUEUE_BYTES)
+        {
+            log.append(string_view(ring.get() + start, length));
+        }
+        else
+        {
+            wrapped.resize(length);
+            copyOut(position + LENGTH_SIZE, &wrapped[0], length);
+            log.append(wrapped);
+        }
+
+        position += LENGTH_SIZE + length;
+        count++;
+    }
+
+    log.flush();
+    head.store(end, memory_order_release);
+    return count;
+}
+
+void BackgroundFlusher::wake()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        wakeRequested = true;
+    }
+    work.notify_one();
+    lastWake = enqueued;
+}
+
+void BackgroundFlusher::copyIn(size_t position, const char* data, size_t length)
+{
+    size_t offset = position % QUEUE_BYTES;
+    size_t first = min(length, QUEUE_BYTES - offset);
+    memcpy(ring.get() + offset, data, first);
+    memcpy(ring.get(), data + first, length - first);
+}
+
+void BackgroundFlusher::copyOut(size_t position, char* data, size_t length) const
+{
+    size_t offset = position % QUEUE_BYTES;
+    size_t first = min(length, QUEUE_BYTES - offset);
+    memcpy(data, ring.get() + offset, first);
+    memcpy(data + first, ring.get(), length - first);
+}
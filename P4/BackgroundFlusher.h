@@ -0,0 +1,105 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#ifndef BACKGROUNDFLUSHER_H
+#define BACKGROUNDFLUSHER_H
+
+#include "SegmentedLog.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+#include <stdexcept>
+
+using namespace std;
+
+class BackgroundFlusher
+{
+    // Class invariant:
+    // - BackgroundFlusher owns one I/O thread that appends records to a SegmentedLog and writes them in large batches,
+    //   so the thread producing the records never waits for the disk.
+    // - Records pass through a lock-free single-producer/single-consumer byte ring; one producer at a time may call
+    //   enqueue and barrier, and successive producers must be ordered by a lock (as partition locks do).
+    // - While the flusher exists, only its thread touches the log, except right after barrier returns and before the
+    //   next enqueue, when the producer may use the log itself.
+    // - A failed write stops the flusher; the error is rethrown by the next enqueue or barrier.
+
+    public:
+        // Preconditions:
+        // - log must outlive the flusher; batchSize and milliseconds must not be negative.
+        // Postconditions:
+        // - Starts the I/O thread. It wakes once batchSize records are pending (0 disables this), at least every
+        //   milliseconds (0 disables this) and on barrier, then writes everything pending with one log flush.
+        BackgroundFlusher(SegmentedLog& log, int batchSize, int milliseconds);
+
+        // Postconditions:
+        // - Pending records are written and the I/O thread has exited; a write error at this point is dropped.
+        ~BackgroundFlusher();
+
+        // Preconditions:
+        // - record must be no longer than SegmentedLog::MAX_RECORD_SIZE bytes.
+        // Postconditions:
+        // - The record is copied into the ring and will be appended to the log after every record enqueued before it.
+        // - Blocks only while the ring is full.
+        void enqueue(string_view record);
+
+        // Postconditions:
+        // - Every record enqueued before the call has been appended and flushed to the log (and fsynced if the log
+        //   syncs on flush), and the I/O thread is idle.
+        void barrier();
+
+    private:
+        // Room for a largest record with its length and as much again, so enqueue always finds space once the
+        // I/O thread has drained the ring.
+        static const size_t QUEUE_BYTES = 2 << 20;
+        static const int LENGTH_SIZE = 4;
+        static_assert(QUEUE_BYTES >= LENGTH_SIZE + static_cast<size_t>(SegmentedLog::MAX_RECORD_SIZE),
+            "A largest record must fit in the ring.");
+
+        SegmentedLog& log;
+        int batchSize;
+        int milliseconds;
+
+        unique_ptr<char[]> ring;
+        atomic<size_t> head;
+        atomic<size_t> tail;
+
+        long long enqueued;
+        long long lastWake;
+        atomic<bool> failed;
+
+        mutex lock;
+        condition_variable work;
+        condition_variable done;
+        long long written;
+        bool wakeRequested;
+        bool stopping;
+        exception_ptr failure;
+
+        thread worker;
+
+        BackgroundFlusher(const BackgroundFlusher& other);
+        BackgroundFlusher& operator=(const BackgroundFlusher& other);
+
+        void run();
+        long long drain();
+        void wake();
+        void copyIn(size_t position, const char* data, size_t length);
+        void copyOut(size_t position, char* data, size_t length) const;
+};
+
+// Implementation invariant:
+// - head and tail count bytes since construction; the ring holds [head, tail) at positions taken modulo QUEUE_BYTES.
+//   Each record is [uint32 length][payload] and may wrap around the end of the ring.
+// - Only the producer writes tail (release, after the bytes) and only the I/O thread writes head (release, after the
+//   records are in the log), so each side sees complete data without a lock.
+// - enqueued and lastWake belong to the producer. written, wakeRequested, stopping and failure are guarded by lock;
+//   the lock is taken once per batch, never per record. failed mirrors failure so enqueue can check it lock-free.
+// - written counts records appended and flushed; barrier waits for it to reach enqueued, and the lock handoff makes
+//   the I/O thread's log changes visible to the producer.
+
+#endif
@@ -0,0 +1,1064 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+// Benchmark driver for the stream classes.
+// Build: g++ -std=c++17 -O2 -pthread Benchmark.cpp MsgStream.cpp MessageArena.cpp DurableStream.cpp PartitionStream.cpp SegmentedLog.cpp BackgroundFlusher.cpp IoRing.cpp StreamMetrics.cpp InMemoryStream.cpp -o Benchmark
+
+#include "SegmentedLog.h"
+#include "MsgStream.h"
+#include "MessageArena.h"
+#include "DurableStream.h"
+#include "PartitionStream.h"
+#include "IoRing.h"
+
+#include <memory>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using namespace std;
+
+const int LOG_MESSAGES = 100000;
+const int RANDOM_READS = 1000;
+
+// Every heap allocation in the process is counted so benchmarks can report allocations per message
+atomic<long long> allocationCount(0);
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    if (void* block = malloc(size == 0 ? 1 : size)) {
+        return block;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void* block) noexcept {
+    free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    free(block);
+}
+
+void benchmarkTextFormat();
+void benchmarkSegmentedLog();
+void benchmarkDurableSync();
+void benchmarkDurabilityPolicies();
+void benchmarkDurabilityPolicy(const string& name, const DurabilityPolicy& policy);
+void benchmarkRangeReads();
+void benchmarkArenaStorage();
+void benchmarkArenaStorage(int messageLength);
+void benchmarkGrowableScaling();
+void benchmarkGrowableScaling(int messages);
+void benchmarkPartitionScaling(int partitions);
+void benchmarkRetention();
+void benchmarkBatchAppend();
+void benchmarkBatchAppend(int batchSize);
+void benchmarkAllocations();
+void benchmarkOperationBudgets();
+void benchmarkOperationBudget(const string& name, const BudgetPolicy& policy);
+void benchmarkRecovery();
+void benchmarkStartup();
+void benchmarkReset();
+void benchmarkSharedFlush();
+double benchmarkSharedFlush(const DurabilityPolicy& policy, IoRing* ring, long long& systemCalls);
+void benchmarkPartitionLookup();
+void benchmarkConcurrentWrites();
+double benchmarkConcurrentWrites(int threads, bool globalLock);
+void benchmarkCommittedReads();
+void benchmarkCommittedReads(int readers);
+
+string makeMessage(int number);
+void removeBenchmarkFiles(const string& prefix);
+double elapsedSeconds(chrono::steady_clock::time_point start);
+double percentile(vector<double>& samples, double fraction);
+void report(const string& name, double value, const string& unit);
+
+int main()
+{
+    try {
+        cout << "=== Benchmarking text format (line per message) ===" << endl;
+        benchmarkTextFormat();
+
+        cout << "\n=== Benchmarking SegmentedLog ===" << endl;
+        benchmarkSegmentedLog();
+
+        cout << "\n=== Benchmarking DurableStream read sync ===" << endl;
+        benchmarkDurableSync();
+
+        cout << "\n=== Benchmarking DurableStream durability policies ===" << endl;
+        benchmarkDurabilityPolicies();
+
+        cout << "\n=== Benchmarking MsgStream range reads (copy vs view) ===" << endl;
+        benchmarkRangeReads();
+
+        cout << "\n=== Benchmarking MsgStream storage (string array vs arena) ===" << endl;
+        benchmarkArenaStorage();
+
+        cout << "\n=== Benchmarking Growable MsgStream scaling ===" << endl;
+        benchmarkGrowableScaling();
+
+        cout << "\n=== Benchmarking PartitionStream key lookup ===" << endl;
+        benchmarkPartitionLookup();
+
+        cout << "\n=== Benchmarking PartitionStream concurrent writes ===" << endl;
+        benchmarkConcurrentWrites();
+
+        cout << "\n=== Benchmarking MsgStream single writer with lock-free readers ===" << endl;
+        benchmarkCommittedReads();
+
+        cout << "\n=== Benchmarking ring-buffer retention ===" << endl;
+        benchmarkRetention();
+
+        cout << "\n=== Benchmarking batch appends ===" << endl;
+        benchmarkBatchAppend();
+
+        cout << "\n=== Benchmarking allocations per message ===" << endl;
+        benchmarkAllocations();
+
+        cout << "\n=== Benchmarking operation budgets ===" << endl;
+        benchmarkOperationBudgets();
+
+        cout << "\n=== Benchmarking log recovery on open ===" << endl;
+        benchmarkRecovery();
+
+        cout << "\n=== Benchmarking startup with and without a snapshot ===" << endl;
+        benchmarkStartup();
+
+        cout << "\n=== Benchmarking DurableStream reset (truncate vs rewrite) ===" << endl;
+        benchmarkReset();
+
+        cout << "\n=== Benchmarking durable partitions: per-stream writes vs one shared ring ===" << endl;
+        benchmarkSharedFlush();
+
+    } catch (const exception& e) {
+        cerr << "Exception occurred: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+// Mirrors the original DurableStream format: one message per line written with endl and read back with getline
+void benchmarkTextFormat() {
+    const string path = "bench_text.txt";
+    remove(path.c_str());
+
+    auto start = chrono::steady_clock::now();
+    {
+        ofstream outFile(path, ios::app);
+        for (int i = 0; i < LOG_MESSAGES; i++) {
+            outFile << makeMessage(i) << endl;
+        }
+    }
+    report("append", LOG_MESSAGES / elapsedSeconds(start), "msgs/sec");
+
+    // A line-per-message file has no offsets, so reaching message N means reading every line before it
+    mt19937 generator(42);
+    uniform_int_distribution<int> pick(0, LOG_MESSAGES - 1);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < RANDOM_READS; i++) {
+        int target = pick(generator);
+        ifstream inFile(path);
+        string line;
+        for (int lineNumber = 0; lineNumber <= target; lineNumber++) {
+            getline(inFile, line);
+        }
+    }
+    report("random read", elapsedSeconds(start) / RANDOM_READS * 1e6, "us/read");
+
+    remove(path.c_str());
+}
+
+void benchmarkSegmentedLog() {
+    const string prefix = "bench_log";
+    removeBenchmarkFiles(prefix);
+
+    auto start = chrono::steady_clock::now();
+    {
+        SegmentedLog log(prefix);
+        for (int i = 0; i < LOG_MESSAGES; i++) {
+            log.append(makeMessage(i));
+            if (i % 3 == 2) {
+                log.flush(); // same write cadence as DurableStream's default policy
+            }
+        }
+    }
+    report("append", LOG_MESSAGES / elapsedSeconds(start), "msgs/sec");
+
+    SegmentedLog log(prefix);
+    cout << "  segments: " << log.getSegmentCount() << endl;
+
+    mt19937 generator(42);
+    uniform_int_distribution<int> pick(0, LOG_MESSAGES - 1);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < RANDOM_READS; i++) {
+        string message = log.read(pick(generator));
+    }
+    report("random read", elapsedSeconds(start) / RANDOM_READS * 1e6, "us/read");
+
+    removeBenchmarkFiles(prefix);
+}
+
+// Every DurableStream read syncs with the backing log; its cost should track new data, not log size
+void benchmarkDurableSync() {
+    const string prefix = "bench_sync";
+    const int reads = 300;
+    removeBenchmarkFiles(prefix);
+
+    {
+        SegmentedLog log(prefix);
+        for (int i = 0; i < LOG_MESSAGES; i++) {
+            log.append(makeMessage(i));
+        }
+    }
+
+    DurableStream stream(200, prefix);
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < reads; i++) {
+        stream.readMessages(0, 1);
+    }
+    report("idle read", elapsedSeconds(start) / reads * 1e6, "us/read");
+
+    SegmentedLog writer(prefix);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < reads / 3; i++) {
+        writer.append(makeMessage(i));
+        writer.flush();
+        stream.readMessages(0, 1);
+    }
+    report("read after tail append", elapsedSeconds(start) / (reads / 3) * 1e6, "us/read");
+
+    removeBenchmarkFiles(prefix);
+}
+
+void benchmarkDurabilityPolicies() {
+    benchmarkDurabilityPolicy("every 3 messages", DurabilityPolicy::defaultPolicy());
+    benchmarkDurabilityPolicy("every 64 messages", DurabilityPolicy::everyMessages(64));
+    benchmarkDurabilityPolicy("every 5 ms", DurabilityPolicy::everyMilliseconds(5));
+    benchmarkDurabilityPolicy("group commit of 3", DurabilityPolicy::groupCommit(3));
+    benchmarkDurabilityPolicy("group commit of 64", DurabilityPolicy::groupCommit(64));
+    benchmarkDurabilityPolicy("background, every 64 or 5 ms", DurabilityPolicy::background(64, 5, false));
+    benchmarkDurabilityPolicy("background group commit of 64", DurabilityPolicy::background(64, 5, true));
+}
+
+// Streams hold at most 200 messages, so each round fills a fresh stream and only the appends are timed
+void benchmarkDurabilityPolicy(const string& name, const DurabilityPolicy& policy) {
+    const string prefix = "bench_policy";
+    const int rounds = 25;
+    const int perRound = 200;
+
+    vector<double> latencies;
+    double total = 0;
+    for (int round = 0; round < rounds; round++) {
+        removeBenchmarkFiles(prefix);
+        DurableStream stream(perRound, prefix, policy);
+
+        for (int i = 0; i < perRound; i++) {
+            string message = makeMessage(i);
+            auto start = chrono::steady_clock::now();
+            stream.appendMessage(message);
+            double seconds = elapsedSeconds(start);
+            latencies.push_back(seconds * 1e6);
+            total += seconds;
+        }
+    }
+
+    cout << "  " << name << endl;
+    report("  throughput", latencies.size() / total, "msgs/sec");
+    report("  p50 latency", percentile(latencies, 0.50), "us");
+    report("  p99 latency", percentile(latencies, 0.99), "us");
+
+    removeBenchmarkFiles(prefix);
+}
+
+// A MsgStream allows 2 * capacity operations, so scans run on fresh copies of a full prototype stream
+void benchmarkRangeReads() {
+    const int capacity = 200;
+    const int rounds = 200;
+
+    MsgStream prototype(capacity);
+    for (int i = 0; i < capacity; i++) {
+        prototype.appendMessage(makeMessage(i));
+    }
+
+    double copySeconds = 0;
+    double viewSeconds = 0;
+    long long scans = 0;
+    size_t checksum = 0;
+
+    for (int round = 0; round < rounds; round++) {
+        MsgStream copying(prototype);
+        MsgStream viewing(prototype);
+        int reads = copying.getMaxOperations() - capacity;
+
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < reads; i++) {
+            unique_ptr<string[]> messages = copying.readMessages(0, capacity - 1);
+            for (int j = 0; j < capacity; j++) {
+                checksum += messages[j].size();
+            }
+        }
+        copySeconds += elapsedSeconds(start);
+
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < reads; i++) {
+            for (string_view message : viewing.viewMessages(0, capacity)) {
+                checksum += message.size();
+            }
+        }
+        viewSeconds += elapsedSeconds(start);
+        scans += reads;
+    }
+
+    report("readMessages (copy)", copySeconds / scans * 1e9 / capacity, "ns/message");
+    report("viewMessages (view)", viewSeconds / scans * 1e9 / capacity, "ns/message");
+    cout << "  (checksum " << checksum << ")" << endl;
+}
+
+void benchmarkArenaStorage() {
+    benchmarkArenaStorage(10);
+    benchmarkArenaStorage(60);
+    benchmarkArenaStorage(150);
+}
+
+// Compares the previous unique_ptr<string[]> layout with MessageArena for a full 200-message stream
+void benchmarkArenaStorage(int messageLength) {
+    const int capacity = 200;
+    const int rounds = 2000;
+    const string message(messageLength, 'a');
+
+    size_t stringBytes = 0;
+    size_t arenaBytes = 0;
+    double stringAppendSeconds = 0;
+    double arenaAppendSeconds = 0;
+    double stringCopySeconds = 0;
+    double arenaCopySeconds = 0;
+    size_t checksum = 0;
+
+    for (int round = 0; round < rounds; round++) {
+        auto start = chrono::steady_clock::now();
+        unique_ptr<string[]> strings(new string[capacity]);
+        for (int i = 0; i < capacity; i++) {
+            strings[i] = message;
+        }
+        stringAppendSeconds += elapsedSeconds(start);
+
+        start = chrono::steady_clock::now();
+        MessageArena arena(capacity);
+        for (int i = 0; i < capacity; i++) {
+            arena.append(message);
+        }
+        arenaAppendSeconds += elapsedSeconds(start);
+
+        start = chrono::steady_clock::now();
+        unique_ptr<string[]> stringCopy(new string[capacity]);
+        for (int i = 0; i < capacity; i++) {
+            stringCopy[i] = strings[i];
+        }
+        stringCopySeconds += elapsedSeconds(start);
+
+        start = chrono::steady_clock::now();
+        MessageArena arenaCopy(arena);
+        arenaCopySeconds += elapsedSeconds(start);
+
+        checksum += stringCopy[capacity - 1].size() + arenaCopy[capacity - 1].size();
+
+        if (round == 0) {
+            stringBytes = capacity * sizeof(string);
+            for (int i = 0; i < capacity; i++) {
+                if (strings[i].capacity() > 15) {
+                    stringBytes += strings[i].capacity() + 1; // heap buffer beyond the small-string buffer
+                }
+            }
+            arenaBytes = arena.bytesReserved();
+        }
+    }
+
+    cout << "  " << messageLength << "-byte messages" << endl;
+    report("  string array memory", stringBytes, "bytes");
+    report("  arena memory", arenaBytes, "bytes");
+    report("  string array append", rounds * capacity / stringAppendSeconds, "msgs/sec");
+    report("  arena append", rounds * capacity / arenaAppendSeconds, "msgs/sec");
+    report("  string array copy", stringCopySeconds / rounds * 1e6, "us/stream");
+    report("  arena copy", arenaCopySeconds / rounds * 1e6, "us/stream");
+    cout << "  (checksum " << checksum << ")" << endl;
+}
+
+void benchmarkGrowableScaling() {
+    for (int messages = 1000; messages <= 10000000; messages *= 10) {
+        benchmarkGrowableScaling(messages);
+    }
+
+}
+
+// Per-message cost should stay flat as the stream grows: appends never relocate storage and memory tracks bytes stored
+void benchmarkGrowableScaling(int messages) {
+    MsgStream stream(messages, CapacityMode::Growable);
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++) {
+        stream.appendMessage(makeMessage(i));
+    }
+    double appendSeconds = elapsedSeconds(start);
+
+    size_t checksum = 0;
+    start = chrono::steady_clock::now();
+    for (string_view message : stream.viewMessages(0, messages)) {
+        checksum += message.size();
+    }
+    double scanSeconds = elapsedSeconds(start);
+
+    cout << "  " << messages << " messages" << endl;
+    report("  append", messages / appendSeconds, "msgs/sec");
+    report("  view scan", scanSeconds / messages * 1e9, "ns/message");
+    report("  storage", static_cast<double>(stream.getStorageBytes()) / messages, "bytes/message");
+    cout << "  (checksum " << checksum << ")" << endl;
+}
+
+void benchmarkPartitionLookup() {
+    for (int partitions = 10; partitions <= 100000; partitions *= 10) {
+        benchmarkPartitionScaling(partitions);
+    }
+}
+
+// Writes are spread over every partition by sequential, reassigned and string keys. Lookups are O(1), so any
+// slowdown at high partition counts comes from touching a cold partition rather than from finding it
+void benchmarkPartitionScaling(int partitions) {
+    const int writesPerPartition = 4;
+    const int writes = max(partitions * writesPerPartition, 400000);
+
+    unique_ptr<MsgStream[]> streams(new MsgStream[partitions]);
+    PartitionStream partitionStream(partitions, move(streams), CapacityMode::Growable);
+    for (int i = 0; i < partitions; i++) {
+        partitionStream.initializeMsgStream(i, writes / partitions * 6 + 64); // room for three uneven passes
+    }
+
+    const string message = makeMessage(1);
+    mt19937 generator(42);
+    uniform_int_distribution<int> pick(0, partitions - 1);
+    vector<int> indices(writes);
+    for (int& index : indices) {
+        index = pick(generator);
+    }
+
+    auto start = chrono::steady_clock::now();
+    for (int index : indices) {
+        partitionStream.writeMessage(index + 1, message);
+    }
+    double sequentialSeconds = elapsedSeconds(start);
+
+    for (int i = 0; i < partitions; i++) {
+        partitionStream.setPartitionKey(i, 1000000 + i * 7);
+    }
+    start = chrono::steady_clock::now();
+    for (int index : indices) {
+        partitionStream.writeMessage(1000000 + index * 7, message);
+    }
+    double reassignedSeconds = elapsedSeconds(start);
+
+    vector<string> names(partitions);
+    for (int i = 0; i < partitions; i++) {
+        names[i] = "partition-" + to_string(i);
+        partitionStream.writeMessage(names[i], message);
+    }
+    start = chrono::steady_clock::now();
+    for (int index : indices) {
+        partitionStream.writeMessage(names[index], message);
+    }
+    double namedSeconds = elapsedSeconds(start);
+
+    cout << "  " << partitions << " partitions" << endl;
+    report("  sequential int keys", writes / sequentialSeconds, "msgs/sec");
+    report("  reassigned int keys", writes / reassignedSeconds, "msgs/sec");
+    report("  string keys", writes / namedSeconds, "msgs/sec");
+}
+
+void benchmarkConcurrentWrites() {
+    unsigned int cores = thread::hardware_concurrency();
+    cout << "  (" << cores << " hardware threads)" << endl;
+    for (int threads = 1; threads <= 32; threads *= 2) {
+        cout << "  " << threads << " producer threads" << endl;
+        report("  one global mutex", benchmarkConcurrentWrites(threads, true), "msgs/sec");
+        report("  partition locks", benchmarkConcurrentWrites(threads, false), "msgs/sec");
+    }
+}
+
+// Each producer spreads its writes over all partitions; globalLock wraps every write in one mutex, which is what
+// callers had to do before PartitionStream synchronised itself
+double benchmarkConcurrentWrites(int threads, bool globalLock) {
+    const int partitions = 1024;
+    const int writesPerThread = 200000;
+
+    unique_ptr<MsgStream[]> streams(new MsgStream[partitions]);
+    PartitionStream partitionStream(partitions, move(streams), CapacityMode::Growable);
+    for (int i = 0; i < partitions; i++) {
+        partitionStream.initializeMsgStream(i, threads * writesPerThread / partitions + 1);
+    }
+
+    const string message = makeMessage(1);
+    mutex everything;
+    vector<thread> producers;
+
+    auto start = chrono::steady_clock::now();
+    for (int t = 0; t < threads; t++) {
+        producers.emplace_back([&, t]() {
+            for (int i = 0; i < writesPerThread; i++) {
+                int key = (i * threads + t) % partitions + 1;
+                if (globalLock) {
+                    lock_guard<mutex> guard(everything);
+                    partitionStream.writeMessage(key, message);
+                } else {
+                    partitionStream.writeMessage(key, message);
+                }
+            }
+        });
+    }
+    for (thread& producer : producers) {
+        producer.join();
+    }
+
+    return threads * static_cast<double>(writesPerThread) / elapsedSeconds(start);
+}
+
+void benchmarkCommittedReads() {
+    for (int readers = 1; readers <= 4; readers *= 2) {
+        benchmarkCommittedReads(readers);
+    }
+}
+
+// Measures how long a message takes from the start of appendMessage until each reader first sees it committed,
+// and prints the latencies as a power-of-two histogram
+void benchmarkCommittedReads(int readers) {
+    const int messages = 1000000;
+
+    MsgStream stream(messages, CapacityMode::Growable);
+    vector<long long> appendStarted(messages);
+    vector<vector<long long>> latencies(readers);
+    auto origin = chrono::steady_clock::now();
+    auto nanosSinceOrigin = [origin]() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - origin).count();
+    };
+
+    vector<thread> readerThreads;
+    for (int r = 0; r < readers; r++) {
+        latencies[r].reserve(messages);
+        readerThreads.emplace_back([&, r]() {
+            long long seen = 0;
+            size_t checksum = 0;
+            while (seen < messages) {
+                long long committed = stream.getCommittedCount();
+                if (committed == seen) {
+                    this_thread::yield();
+                    continue;
+                }
+                long long now = nanosSinceOrigin();
+                for (string_view message : stream.viewCommitted(seen, committed)) {
+                    checksum += message.size();
+                }
+                for (long long i = seen; i < committed; i++) {
+                    latencies[r].push_back(now - appendStarted[i]);
+                }
+                seen = committed;
+            }
+            if (checksum == 0) {
+                cout << "  (no bytes read)" << endl;
+            }
+        });
+    }
+
+    const string message = makeMessage(1);
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++) {
+        appendStarted[i] = nanosSinceOrigin();
+        stream.appendMessage(message);
+    }
+    double appendSeconds = elapsedSeconds(start);
+    for (thread& reader : readerThreads) {
+        reader.join();
+    }
+
+    vector<double> all;
+    for (const vector<long long>& readerLatencies : latencies) {
+        all.insert(all.end(), readerLatencies.begin(), readerLatencies.end());
+    }
+
+    vector<long long> histogram(40, 0);
+    for (double latency : all) {
+        int bucket = 0;
+        while (bucket < 39 && (1LL << (bucket + 1)) <= static_cast<long long>(latency)) {
+            bucket++;
+        }
+        histogram[bucket]++;
+    }
+
+    cout << "  " << readers << " reader threads" << endl;
+    report("  append", messages / appendSeconds, "msgs/sec");
+    report("  p50 visible after", percentile(all, 0.50), "ns");
+    report("  p99 visible after", percentile(all, 0.99), "ns");
+    report("  p99.9 visible after", percentile(all, 0.999), "ns");
+    for (int bucket = 0; bucket < 40; bucket++) {
+        if (histogram[bucket] > 0) {
+            cout << "    < " << setw(12) << (1LL << (bucket + 1)) << " ns  " << histogram[bucket] << endl;
+        }
+    }
+}
+
+// Always-on ingestion into a stream that keeps the latest 10k messages; storage should stop growing once it wraps
+void benchmarkRetention() {
+    const int retained = 10000;
+    const int messages = 5000000;
+    MsgStream stream(retained, CapacityMode::Growable, RetentionPolicy::keepLatest());
+
+    for (int i = 0; i < retained; i++) {
+        stream.appendMessage(makeMessage(i));
+    }
+    size_t warmStorage = stream.getStorageBytes();
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < messages; i++) {
+        stream.appendMessage(makeMessage(i));
+    }
+    double seconds = elapsedSeconds(start);
+
+    report("append with eviction", messages / seconds, "msgs/sec");
+    report("storage after warmup", warmStorage, "bytes");
+    report("storage at end", stream.getStorageBytes(), "bytes");
+    cout << "  retained offsets [" << stream.getFirstOffset() << ", " << stream.getNextOffset() << ")" << endl;
+}
+
+void benchmarkBatchAppend() {
+    benchmarkBatchAppend(1);
+    benchmarkBatchAppend(16);
+    benchmarkBatchAppend(64);
+    benchmarkBatchAppend(256);
+}
+
+// Batch size 1 uses the per-message calls, so each larger size is measured against the loop it replaces
+void benchmarkBatchAppend(int batchSize) {
+    const int messages = 1 << 20;
+    const int partitions = 64;
+    const string prefix = "bench_batch";
+
+    vector<string> pool;
+    for (int i = 0; i < 1024; i++) {
+        pool.push_back(makeMessage(i));
+    }
+    vector<string_view> views(pool.begin(), pool.end());
+    vector<pair<int, string>> writes;
+    for (int i = 0; i < batchSize; i++) {
+        writes.emplace_back(i % partitions + 1, pool[i % pool.size()]);
+    }
+
+    cout << "  batch of " << batchSize << endl;
+
+    MsgStream stream(messages, CapacityMode::Growable);
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < messages; i += batchSize) {
+        if (batchSize == 1) {
+            stream.appendMessage(pool[i % pool.size()]);
+        } else {
+            stream.appendBatch(views.data() + i % pool.size(), batchSize);
+        }
+    }
+    report("  MsgStream", messages / elapsedSeconds(start), "msgs/sec");
+
+    // Small batches repeat the same few keys, so every partition is sized to take the whole run
+    PartitionStream partitioned(partitions, unique_ptr<MsgStream[]>(new MsgStream[partitions]), CapacityMode::Growable);
+    for (int i = 0; i < partitions; i++) {
+        partitioned.initializeMsgStream(i, messages);
+    }
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < messages; i += batchSize) {
+        if (batchSize == 1) {
+            partitioned.writeMessage(i % partitions + 1, pool[i % pool.size()]);
+        } else {
+            partitioned.writeBatch(writes);
+        }
+    }
+    report("  PartitionStream", messages / elapsedSeconds(start), "msgs/sec");
+
+    // Streams hold at most 200 messages; with the policy flushing every message, batching sets the write count
+    const int rounds = 25;
+    const int perRound = 200;
+    double total = 0;
+    for (int round = 0; round < rounds; round++) {
+        removeBenchmarkFiles(prefix);
+        DurableStream durable(perRound, prefix, DurabilityPolicy::everyMessages(1));
+
+        start = chrono::steady_clock::now();
+        for (int i = 0; i < perRound; i += batchSize) {
+            int count = min(batchSize, perRound - i);
+            if (batchSize == 1) {
+                durable.appendMessage(pool[i]);
+            } else {
+                durable.appendBatch(views.data() + i, count);
+            }
+        }
+        total += elapsedSeconds(start);
+    }
+    report("  DurableStream", rounds * perRound / total, "msgs/sec");
+
+    removeBenchmarkFiles(prefix);
+}
+
+// Messages are longer than the small-string buffer, so every std::string built for one costs an allocation
+void benchmarkAllocations() {
+    const int messages = 100000;
+    const string prefix = "bench_allocations";
+    const string text = makeMessage(42);
+    const string_view view = text;
+    long long before;
+
+    MsgStream fromString(messages, CapacityMode::Growable);
+    before = allocationCount.load();
+    for (int i = 0; i < messages; i++) {
+        fromString.appendMessage(makeMessage(i));
+    }
+    report("built std::string", double(allocationCount.load() - before) / messages, "allocs/msg");
+
+    MsgStream fromView(messages, CapacityMode::Growable);
+    before = allocationCount.load();
+    for (int i = 0; i < messages; i++) {
+        fromView.appendMessage(view);
+    }
+    report("string_view", double(allocationCount.load() - before) / messages, "allocs/msg");
+
+    MsgStream emplaced(messages, CapacityMode::Growable);
+    before = allocationCount.load();
+    for (int i = 0; i < messages; i++) {
+        emplaced.emplaceMessage(view.size(), [&view](char* destination) {
+            memcpy(destination, view.data(), view.size());
+        });
+    }
+    report("emplaceMessage", double(allocationCount.load() - before) / messages, "allocs/msg");
+
+    before = allocationCount.load();
+    MsgStream merged = fromView + emplaced;
+    report("operator+", double(allocationCount.load() - before) / merged.getMessageCount(), "allocs/msg");
+
+    MsgStream target(2 * messages, CapacityMode::Growable);
+    before = allocationCount.load();
+    target += fromView;
+    report("operator+=", double(allocationCount.load() - before) / messages, "allocs/msg");
+
+    PartitionStream partitioned(16, unique_ptr<MsgStream[]>(new MsgStream[16]), CapacityMode::Growable);
+    for (int i = 0; i < 16; i++) {
+        partitioned.initializeMsgStream(i, messages);
+    }
+    before = allocationCount.load();
+    for (int i = 0; i < messages; i++) {
+        partitioned.writeMessage(i % 16 + 1, view);
+    }
+    report("PartitionStream", double(allocationCount.load() - before) / messages, "allocs/msg");
+
+    // Streams hold at most 200 messages, so each round fills a fresh stream and only the appends are counted
+    const int rounds = 50;
+    const int perRound = 200;
+    long long durableAllocations = 0;
+    for (int round = 0; round < rounds; round++) {
+        removeBenchmarkFiles(prefix);
+        DurableStream durable(perRound, prefix, DurabilityPolicy::everyMessages(64));
+        before = allocationCount.load();
+        for (int i = 0; i < perRound; i++) {
+            durable.appendMessage(view);
+        }
+        durableAllocations += allocationCount.load() - before;
+    }
+    report("DurableStream", double(durableAllocations) / (rounds * perRound), "allocs/msg");
+
+    removeBenchmarkFiles(prefix);
+}
+
+void benchmarkOperationBudgets() {
+    benchmarkOperationBudget("unlimited", BudgetPolicy::unlimited());
+    benchmarkOperationBudget("lifetime", BudgetPolicy::lifetime(1LL << 40));
+    benchmarkOperationBudget("token bucket", BudgetPolicy::tokenBucket(1LL << 40, 1LL << 40));
+    benchmarkOperationBudget("token bucket at its rate", BudgetPolicy::tokenBucket(5000000, 1000));
+}
+
+// The rate-limited case refills constantly, so it shows the cost of the clock read on the slow path
+void benchmarkOperationBudget(const string& name, const BudgetPolicy& policy) {
+    const int operations = 5000000;
+    const int partitions = 64;
+
+    MsgStream stream(1, CapacityMode::Growable);
+    stream.appendMessage("budget");
+    stream.setOperationBudget(policy);
+    long long refused = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < operations; i++) {
+        try {
+            stream.viewMessages(0, 1);
+        } catch (const runtime_error&) {
+            refused++;
+        }
+    }
+    double seconds = elapsedSeconds(start);
+
+    PartitionStream partitioned(partitions, unique_ptr<MsgStream[]>(new MsgStream[partitions]), CapacityMode::Growable);
+    for (int i = 0; i < partitions; i++) {
+        partitioned.initializeMsgStream(i, operations);
+    }
+    partitioned.setOperationBudget(policy);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < operations; i++) {
+        try {
+            partitioned.writeMessage(i % partitions + 1, "budget");
+        } catch (const runtime_error&) {
+            refused++;
+        }
+    }
+    double partitionSeconds = elapsedSeconds(start);
+
+    cout << "  " << name << endl;
+    report("  MsgStream view", seconds / operations * 1e9, "ns/op");
+    report("  PartitionStream write", partitionSeconds / operations * 1e9, "ns/op");
+    report("  refused", refused, "ops");
+}
+
+// The log is grown in place to each size; every open after the first size recovers the same, larger log
+void benchmarkRecovery() {
+    const string prefix = "bench_recovery";
+    const long long sizes[] = { 64LL << 20, 512LL << 20, 2048LL << 20 };
+    const string payload(100, 'r');
+
+    removeBenchmarkFiles(prefix);
+    long long written = 0;
+    for (long long size : sizes) {
+        {
+            SegmentedLog log(prefix);
+            while (written < size) {
+                log.append(payload);
+                written += payload.size() + 8;
+            }
+        }
+
+        auto start = chrono::steady_clock::now();
+        SegmentedLog reopened(prefix);
+        double seconds = elapsedSeconds(start);
+        RecoveryReport recovery = reopened.getRecoveryReport();
+
+        start = chrono::steady_clock::now();
+        DurableStream durable(200, prefix);
+        double durableSeconds = elapsedSeconds(start);
+
+        // Leave half a record at the end of the active segment, as a crash mid-write would
+        string active;
+        for (const auto& entry : filesystem::directory_iterator(".")) {
+            string name = entry.path().filename().string();
+            if (name.rfind(prefix + ".", 0) == 0 && name.size() > 4 && name.compare(name.size() - 4, 4, ".log") == 0) {
+                active = max(active, name);
+            }
+        }
+        {
+            ofstream segment(active, ios::app | ios::binary);
+            segment.write(payload.data(), 50);
+        }
+        start = chrono::steady_clock::now();
+        SegmentedLog recovered(prefix);
+        double tornSeconds = elapsedSeconds(start);
+
+        cout << "  " << (size >> 20) << " MB, " << reopened.getMessageCount() << " records, "
+             << recovery.segmentsLoaded << " segments" << endl;
+        report("  SegmentedLog open", seconds * 1000, "ms");
+        report("  records checked", recovery.recordsScanned, "records");
+        report("  DurableStream open", durableSeconds * 1000, "ms");
+        report("  open with torn tail", tornSeconds * 1000, "ms");
+        report("  bytes truncated", recovered.getRecoveryReport().bytesTruncated, "bytes");
+    }
+
+    removeBenchmarkFiles(prefix);
+}
+
+// Opening without the snapshot checks the tail of every sealed segment, which is what the snapshot saves
+void benchmarkStartup() {
+    const string prefix = "bench_startup";
+    const long long sizes[] = { 1LL << 20, 10LL << 20, 100LL << 20, 1LL << 30, 10LL << 30 };
+    const string payload(100, 's');
+
+    removeBenchmarkFiles(prefix);
+    long long written = 0;
+    for (long long size : sizes) {
+        {
+            SegmentedLog log(prefix);
+            while (written < size) {
+                log.append(payload);
+                written += payload.size() + 8;
+            }
+        }
+
+        auto start = chrono::steady_clock::now();
+        long long segments;
+        long long fromSnapshot;
+        {
+            SegmentedLog log(prefix);
+            segments = log.getSegmentCount();
+            fromSnapshot = log.getRecoveryReport().segmentsFromSnapshot;
+        }
+        double snapshotSeconds = elapsedSeconds(start);
+
+        start = chrono::steady_clock::now();
+        {
+            DurableStream durable(200, prefix);
+        }
+        double durableSeconds = elapsedSeconds(start);
+
+        filesystem::remove(prefix + ".snapshot");
+        start = chrono::steady_clock::now();
+        {
+            SegmentedLog log(prefix);
+        }
+        double fullSeconds = elapsedSeconds(start);
+
+        cout << "  " << (size >> 20) << " MB, " << segments << " segments, " << fromSnapshot << " from snapshot" << endl;
+        report("  open with snapshot", snapshotSeconds * 1000, "ms");
+        report("  DurableStream open", durableSeconds * 1000, "ms");
+        report("  open without snapshot", fullSeconds * 1000, "ms");
+    }
+
+    removeBenchmarkFiles(prefix);
+}
+
+// The rewrite mirrors the previous reset: clear every segment, then append and flush the initial messages again
+void benchmarkReset() {
+    const string prefix = "bench_reset";
+    const int baseline = 100;
+    const int rounds = 1000;
+
+    removeBenchmarkFiles(prefix);
+    {
+        SegmentedLog log(prefix);
+        for (int i = 0; i < baseline; i++) {
+            log.append(makeMessage(i));
+        }
+    }
+
+    DurableStream durable(baseline * 2, prefix);
+    durable.setOperationBudget(BudgetPolicy::unlimited());
+    double truncateSeconds = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < baseline; i++) {
+            durable.appendMessage(makeMessage(i));
+        }
+        auto start = chrono::steady_clock::now();
+        durable.reset();
+        truncateSeconds += elapsedSeconds(start);
+    }
+
+    SegmentedLog log(prefix + ".rewrite");
+    double rewriteSeconds = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < baseline * 2; i++) {
+            log.append(makeMessage(i));
+        }
+        log.flush();
+        auto start = chrono::steady_clock::now();
+        log.clear();
+        for (int i = 0; i < baseline; i++) {
+            log.append(makeMessage(i));
+        }
+        log.flush();
+        rewriteSeconds += elapsedSeconds(start);
+    }
+
+    cout << "  " << baseline << " initial messages, " << baseline << " appended before each reset" << endl;
+    report("  reset by truncating", truncateSeconds / rounds * 1e6, "us");
+    report("  reset by rewriting", rewriteSeconds / rounds * 1e6, "us");
+
+    removeBenchmarkFiles(prefix);
+}
+
+// Both sides write every partition's records after each 3 of its messages; the shared ring does it for all at once
+void benchmarkSharedFlush() {
+    for (bool sync : { false, true }) {
+        long long systemCalls = 0;
+        DurabilityPolicy perStream = sync ? DurabilityPolicy::groupCommit(3) : DurabilityPolicy::everyMessages(3);
+        double perStreamRate = benchmarkSharedFlush(perStream, nullptr, systemCalls);
+
+        IoRing uring;
+        double uringRate = benchmarkSharedFlush(DurabilityPolicy::onDemand(sync), &uring, systemCalls);
+        long long uringCalls = systemCalls;
+
+        IoRing fallback(IoRing::DEFAULT_ENTRIES, false);
+        double writeRate = benchmarkSharedFlush(DurabilityPolicy::onDemand(sync), &fallback, systemCalls);
+
+        cout << "  256 partitions, " << (sync ? "fdatasync after each write" : "no fsync")
+             << (uring.usesUring() ? "" : " (io_uring unavailable, both rings use write)") << endl;
+        report("  per-stream writes", perStreamRate, "msgs/sec");
+        report("  shared ring, io_uring", uringRate, "msgs/sec");
+        report("  shared ring, write", writeRate, "msgs/sec");
+        report("  io_uring calls", uringCalls, "calls");
+        report("  write calls", systemCalls, "calls");
+    }
+}
+
+double benchmarkSharedFlush(const DurabilityPolicy& policy, IoRing* ring, long long& systemCalls) {
+    const string prefix = "bench_shared";
+    const int partitions = 256;
+    const int rounds = 192;
+
+    removeBenchmarkFiles(prefix);
+    vector<unique_ptr<MsgStream>> streams;
+    for (int i = 0; i < partitions; i++) {
+        streams.push_back(unique_ptr<MsgStream>(new DurableStream(rounds, prefix + "." + to_string(i), policy)));
+    }
+    long long callsBefore = ring ? ring->getSystemCalls() : 0;
+    double seconds;
+    {
+        PartitionStream partitionStream(move(streams), CapacityMode::Growable);
+        auto start = chrono::steady_clock::now();
+        for (int round = 0; round < rounds; round++) {
+            for (int key = 1; key <= partitions; key++) {
+                partitionStream.writeMessage(key, makeMessage(round));
+            }
+            if (ring && round % 3 == 2) {
+                partitionStream.flushDurablePartitions(*ring);
+            }
+        }
+        seconds = elapsedSeconds(start);
+    }
+    systemCalls = ring ? ring->getSystemCalls() - callsBefore : 0;
+
+    removeBenchmarkFiles(prefix);
+    return static_cast<double>(partitions) * rounds / seconds;
+}
+
+string makeMessage(int number) {
+    return "benchmark message " + to_string(number) + " " + string(number % 100, 'x');
+}
+
+void removeBenchmarkFiles(const string& prefix) {
+    for (const auto& entry : filesystem::directory_iterator(".")) {
+        if (entry.path().filename().string().rfind(prefix + ".", 0) == 0) {
+            filesystem::remove(entry.path());
+        }
+    }
+}
+
+double elapsedSeconds(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+double percentile(vector<double>& samples, double fraction) {
+    sort(samples.begin(), samples.end());
+    return samples[static_cast<size_t>(fraction * (samples.size() - 1))];
+}
+
+void report(const string& name, double value, const string& unit) {
+    cout << "  " << left << setw(24) << name << fixed << setprecision(2) << value << " " << unit << endl;
+}
@@ -0,0 +1,89 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#ifndef DURABILITYPOLICY_H
+#define DURABILITYPOLICY_H
+
+#include <stdexcept>
+
+using namespace std;
+
+struct DurabilityPolicy
+{
+    // Class invariant:
+    // - DurabilityPolicy decides when a DurableStream writes its buffered records to the backing log.
+    // - flushEveryMessages triggers a write once that many records are pending; 0 disables the count trigger.
+    // - flushEveryMilliseconds triggers a write on the first append after that much time has passed since
+    //   the previous write; 0 disables the time trigger.
+    // - syncOnFlush forces every write to reach stable storage (fdatasync), so each write is a group commit.
+    // - With both triggers disabled, records are written only on reads, reset, or destruction.
+    // - flushInBackground hands records to a BackgroundFlusher thread, which the triggers wake instead of the appending
+    //   thread writing itself; the time trigger then fires even while no messages arrive.
+
+    int flushEveryMessages;
+    int flushEveryMilliseconds;
+    bool syncOnFlush;
+    bool flushInBackground;
+
+    // Postconditions:
+    // - Returns the original DurableStream behaviour: a buffered write every 3 messages without fsync.
+    static DurabilityPolicy defaultPolicy()
+    {
+        return everyMessages(3);
+    }
+
+    // Preconditions:
+    // - count must be greater than 0.
+    static DurabilityPolicy everyMessages(int count)
+    {
+        if (count <= 0)
+            throw invalid_argument("Flush count must be positive.");
+        return DurabilityPolicy{ count, 0, false, false };
+    }
+
+    // Preconditions:
+    // - milliseconds must be greater than 0.
+    static DurabilityPolicy everyMilliseconds(int milliseconds)
+    {
+        if (milliseconds <= 0)
+            throw invalid_argument("Flush interval must be positive.");
+        return DurabilityPolicy{ 0, milliseconds, false, false };
+    }
+
+    // Preconditions:
+    // - batchSize must be greater than 0.
+    // Postconditions:
+    // - Returns a policy that writes and fsyncs each batch of batchSize records with a single write call.
+    static DurabilityPolicy groupCommit(int batchSize)
+    {
+        if (batchSize <= 0)
+            throw invalid_argument("Batch size must be positive.");
+        return DurabilityPolicy{ batchSize, 0, true, false };
+    }
+
+    // Postconditions:
+    // - Returns a policy with both triggers disabled, for streams whose owner decides when to write, such as the
+    //   durable partitions of a PartitionStream flushed together with flushDurablePartitions.
+    static DurabilityPolicy onDemand(bool syncOnFlush)
+    {
+        return DurabilityPolicy{ 0, 0, syncOnFlush, false };
+    }
+
+    // Preconditions:
+    // - batchSize and milliseconds must be greater than 0.
+    // Postconditions:
+    // - Returns a policy whose records are written by a background thread once batchSize are pending and at least
+    //   every milliseconds, fsynced if syncOnFlush is set; appends only copy the record into a queue.
+    static DurabilityPolicy background(int batchSize, int milliseconds, bool syncOnFlush)
+    {
+        if (batchSize <= 0 || milliseconds <= 0)
+            throw invalid_argument("Background flush triggers must be positive.");
+        return DurabilityPolicy{ batchSize, milliseconds, syncOnFlush, true };
+    }
+};
+
+// Implementation invariant:
+// - flushEveryMessages and flushEveryMilliseconds are never negative.
+// - Policies are plain values so each partition's DurableStream can be configured independently.
+
+#endif
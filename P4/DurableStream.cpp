@@ -4,102 +4,118 @@
 #include "DurableStream.h"
 #include "MsgStream.h"
 
+#include "SegmentedLog.h"
+#include "BackgroundFlusher.h"
+#include "IoRing.h"
+#include "StreamMetrics.h"
+
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
 #include <fstream>
+#include <filesystem>
 #include <stdexcept>
-#include <iostream>
 
 using namespace std;
 
-DurableStream::DurableStream(int capacity, const string& filePath) : MsgStream(capacity), appendCounter(0)
+DurableStream::DurableStream(int capacity, const string& filePath)
+    : DurableStream(capacity, filePath, DurabilityPolicy::defaultPolicy()) {}
+
+DurableStream::DurableStream(int capacity, const string& filePath, const DurabilityPolicy& policy)
+    : MsgStream(capacity), policy(policy), lastWrite(chrono::steady_clock::now()), filePath(filePath),
+      initialCount(0), capacity(getCapacity()), appendCounter(0), pendingBytes(0), baselineIntact(true)
 {
     if (!isValidFilePath(filePath)) 
     {
         throw invalid_argument("Invalid file path.");
     }
 
-    ifstream inFile(filePath);
-    if (inFile.is_open())
+    if (policy.flushEveryMessages < 0 || policy.flushEveryMilliseconds < 0)
     {
-        string line;
-        while (getline(inFile, line))
-        {
-            this->appendMessage(line);
-        }
-        inFile.close();
+        throw invalid_argument("Invalid durability policy.");
     }
 
-    outFile.open(filePath, ios::app);
-    if (!outFile.is_open())
+    log = shared_ptr<SegmentedLog>(new SegmentedLog(filePath));
+    log->setSyncOnFlush(policy.syncOnFlush);
+
+    if (log->wasCreated())
+    {
+        importLegacyFile();
+    }
+
+    syncMessages();
+
+    initialState.reserve(messageCount);
+    for (int i = 0; i < messageCount; i++)
     {
-        throw runtime_error("Failed to open file for writing.");
+        initialState.push_back(string(messages[i]));
     }
+    initialCount = messageCount;
+
+    startFlusher();
 }
 
 DurableStream::DurableStream(const DurableStream& other) : MsgStream(other)
 {
+    policy = other.policy;
+    lastWrite = chrono::steady_clock::now();
     capacity = other.capacity;
-    appendCounter = other.appendCounter;
+    appendCounter = 0;
+    pendingBytes = 0;
+    initialCount = other.initialCount;
+    baselineIntact = other.baselineIntact;
     messageCount = other.messageCount;
     filePath = other.filePath;
 
-    messages = std::unique_ptr<std::string[]>(new std::string[capacity]);
-    for (int i = 0; i < messageCount && i < capacity; i++)
-    {
-        messages[i] = other.messages[i];
-    }
+    other.drainFlusher();
+    log = other.log;
+    flusher = other.flusher;
+    initialState = other.initialState;
+}
 
-    if (other.initialState) {
-        initialState = std::unique_ptr<std::string[]>(new std::string[capacity]);
-        for (int i = 0; i < messageCount && i < capacity; i++)
-        {
-            initialState[i] = other.initialState[i];
-        }
-    } 
-    else
-    {
-        initialState = nullptr;
-    }
+unique_ptr<MsgStream> DurableStream::clone() const
+{
+    return unique_ptr<MsgStream>(new DurableStream(*this));
 }
 
 DurableStream& DurableStream::operator=(const DurableStream& other)
 {
     if (this == &other) return *this;
 
+    flusher.reset();
     MsgStream::operator=(other);
 
+    policy = other.policy;
+    lastWrite = chrono::steady_clock::now();
     capacity = other.capacity;
-    appendCounter = other.appendCounter;
+    appendCounter = 0;
+    pendingBytes = 0;
+    initialCount = other.initialCount;
+    baselineIntact = other.baselineIntact;
     messageCount = other.messageCount;
     filePath = other.filePath;
 
-    messages = std::unique_ptr<std::string[]>(new std::string[capacity]);
-    for (int i = 0; i < messageCount; i++)
-    {
-        messages[i] = other.messages[i];
-    }
-
-    if (other.initialState)
-    {
-        initialState = std::unique_ptr<std::string[]>(new std::string[capacity]);
-        for (int i = 0; i < messageCount; i++)
-        {
-            initialState[i] = other.initialState[i];
-        }
-    } else
-    {
-        initialState = nullptr;
-    }
+    other.drainFlusher();
+    log = other.log;
+    flusher = other.flusher;
+    initialState = other.initialState;
 
     return *this;
 }
 
 DurableStream::DurableStream(DurableStream&& other) noexcept
-    : MsgStream(move(other)), filePath(""), capacity(0), appendCounter(0) {
-    swap(messages, other.messages);
+    : MsgStream(move(other)), policy(other.policy), lastWrite(other.lastWrite), filePath(""),
+      initialCount(0), capacity(0), appendCounter(0), pendingBytes(0), baselineIntact(true) {
+    swap(log, other.log);
+    swap(flusher, other.flusher);
     swap(initialState, other.initialState);
+    swap(initialCount, other.initialCount);
+    swap(baselineIntact, other.baselineIntact);
+    swap(capacity, other.capacity);
     swap(appendCounter, other.appendCounter);
+    swap(pendingBytes, other.pendingBytes);
     swap(filePath, other.filePath);
 }
 
@@ -109,110 +125,322 @@ DurableStream& DurableStream::operator=(DurableStream&& other) noexcept
 
     MsgStream::operator=(move(other));
 
+    policy = other.policy;
+    lastWrite = other.lastWrite;
     capacity = other.capacity;
     appendCounter = other.appendCounter;
+    pendingBytes = other.pendingBytes;
 
-    messages = move(other.messages);
+    flusher.reset();
+    log = move(other.log);
+    flusher = move(other.flusher);
     initialState = move(other.initialState);
+    initialCount = other.initialCount;
+    baselineIntact = other.baselineIntact;
     filePath = move(other.filePath);
 
     other.capacity = 0;
     other.appendCounter = 0;
+    other.pendingBytes = 0;
+    other.initialCount = 0;
 
     return * this;    
 }
 
-void DurableStream::appendMessage(const string& message)
+void DurableStream::appendMessage(string_view message)
 {
+    syncSharedLog();
+
     if (isFull())
-        throw runtime_error("Capacity has been reached.");
+        throw rejected(RejectReason::Full, runtime_error("Capacity has been reached."));
 
     if (operationLimit())
-        throw runtime_error("Operation limit has been reached.");
+        throw rejected(RejectReason::OperationLimit, runtime_error("Operation limit has been reached."));
 
     if (!isValidMessage(message))
-        throw runtime_error("Invalid message.");
+        throw rejected(RejectReason::Invalid, runtime_error("Invalid message."));
 
     MsgStream::appendMessage(message);
+    pendingBytes += static_cast<long long>(message.size());
+    if (flusher)
+    {
+        flusher->enqueue(message);
+        return;
+    }
+
+    log->append(message);
     appendCounter++;
 
-    if (appendCounter >= WRITE_THRESHOLD)
+    if (writeDue())
     {
-        unique_ptr<string[]> messagesToWrite = getLastMessages(WRITE_THRESHOLD);
-        writeMessageToFile(move(messagesToWrite));
-        appendCounter = 0;
+        writeMessageToFile();
+    }
+}
+
+void DurableStream::appendBatch(const string_view* batch, int count)
+{
+    syncSharedLog();
+    MsgStream::appendBatch(batch, count);
+
+    for (int i = 0; i < count; i++)
+    {
+        pendingBytes += static_cast<long long>(batch[i].size());
+    }
+
+    if (flusher)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            flusher->enqueue(batch[i]);
+        }
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        log->append(batch[i]);
+    }
+    appendCounter += count;
+
+    if (count > 0 && writeDue())
+    {
+        writeMessageToFile();
     }
 }
 
-unique_ptr<string[]> DurableStream::readMessages(int startRange, int endRange)
+unique_ptr<string[]> DurableStream::readMessages(long long startRange, long long endRange)
 {
     syncMessages();
 
     return MsgStream::readMessages(startRange, endRange);
 }
 
+MessageRange DurableStream::viewMessages(long long startRange, long long endRange)
+{
+    syncMessages();
+
+    return MsgStream::viewMessages(startRange, endRange);
+}
+
+vector<string_view> DurableStream::readMessageViews(long long startRange, long long endRange)
+{
+    if (operationLimit())
+        throw rejected(RejectReason::OperationLimit, runtime_error("Operation limit has been reached."));
+
+    syncMessages();
+
+    if (startRange < 0 || endRange < startRange || endRange > log->getMessageCount())
+        throw rejected(RejectReason::Invalid, out_of_range("Invalid range for reading log."));
+
+    long long started = metrics ? StreamMetrics::now() : 0;
+    vector<string_view> views = log->viewRange(startRange, endRange);
+    countOperation();
+    if (metrics)
+        metrics->recordRead(static_cast<long long>(views.size()), StreamMetrics::now() - started);
+    return views;
+}
+
 void DurableStream::reset()
 {
-    messages = std::unique_ptr<std::string[]>(new std::string[capacity]);
+    drainFlusher();
+
+    messages.clear();
     messageCount = 0;
+    invalidateViews();
 
-    for (int i = 0; i < capacity && !initialState[i].empty(); i++)
+    for (int i = 0; i < initialCount; i++)
     {
-        messages[i] = initialState[i];
+        messages.append(initialState[i]);
         messageCount++;
     }
 
-    ofstream outFile(filePath, ios::trunc); // truncate to clear file
-    if (outFile.is_open())
+    if (log->refresh())
     {
+        baselineIntact = false;
+    }
+
+    // The log still starts with the initial messages unless it was replaced, so cutting it back is enough.
+    if (baselineIntact && log->getMessageCount() >= initialCount)
+    {
+        log->truncate(initialCount);
+    }
+    else
+    {
+        log->clear();
         for (int i = 0; i < messageCount; i++)
         {
-            outFile << messages[i] << endl;
+            log->append(initialState[i]);
         }
-        outFile.close();
+        log->flush();
     }
 
+    baselineIntact = true;
     appendCounter = 0;
+    pendingBytes = 0;
 }
 
 void DurableStream::syncMessages()
 {
-    initialState = std::unique_ptr<std::string[]>(new std::string[capacity]);
+    long long started = metrics ? StreamMetrics::now() : 0;
+    drainFlusher();
+
+    if (log->refresh() || messageCount > log->getMessageCount())
+    {
+        // The backing log was truncated or replaced underneath us, so the in-memory copy is rebuilt from scratch.
+        messages.clear();
+        messageCount = 0;
+        appendCounter = 0;
+        baselineIntact = false;
+        invalidateViews();
+    }
 
-    ifstream inFile(filePath);
-    if (inFile.is_open())
+    long long available = min<long long>(log->getMessageCount(), capacity);
+    int firstUnseen = messageCount;
+    if (available > firstUnseen)
     {
-        string line;
-        int index = 0;
-        while (getline(inFile, line) && index < capacity)
+        vector<string_view> unseen = log->viewRange(firstUnseen, available);
+        for (int i = 0; i < available - firstUnseen; i++)
         {
-            if (isValidMessage(line))
-            {
-                MsgStream::appendMessage(line);
-                initialState[index++] = line;
-            }
+            ingestMessage(unseen[i]);
         }
-        inFile.close();
     }
+
+    if (metrics)
+        metrics->recordSync(messageCount - firstUnseen, StreamMetrics::now() - started);
 }
 
-void DurableStream::writeMessageToFile(unique_ptr<string[]> messages)
+void DurableStream::setDurabilityPolicy(const DurabilityPolicy& policy)
 {
-    for (int i = 0; i < WRITE_THRESHOLD; i++)
+    if (policy.flushEveryMessages < 0 || policy.flushEveryMilliseconds < 0)
     {
-        outFile << messages[i] << endl;
+        throw invalid_argument("Invalid durability policy.");
     }
+
+    if (log.use_count() > 1)
+    {
+        throw runtime_error("The durability policy of a shared log cannot be changed.");
+    }
+
+    // The old flusher drains before the log's sync setting changes under it.
+    flusher.reset();
+    this->policy = policy;
+    log->setSyncOnFlush(policy.syncOnFlush);
+    startFlusher();
 }
 
-unique_ptr<string[]> DurableStream::getLastMessages(int count) const
+DurabilityPolicy DurableStream::getDurabilityPolicy() const
 {
-    std::unique_ptr<std::string[]> messages(new std::string[count]);
-    int startIndex = messageCount - count;
-    for (int i = 0; i < count; i++)
+    return policy;
+}
+
+long long DurableStream::getLogMessageCount() const
+{
+    drainFlusher();
+    return log->getMessageCount();
+}
+
+RecoveryReport DurableStream::getRecoveryReport() const
+{
+    return log->getRecoveryReport();
+}
+
+void DurableStream::flush()
+{
+    writeMessageToFile();
+}
+
+void DurableStream::queueWrite(IoRing& ring)
+{
+    if (flusher)
+    {
+        drainFlusher();
+    }
+    else
     {
-        messages[i] = this->messages[startIndex + i];
+        log->queueFlush(ring);
     }
-    return messages;
+
+    // The write happens when ring is submitted, so only its submitter can time it.
+    if (metrics && pendingBytes > 0)
+        metrics->recordFlush(pendingBytes, -1);
+    pendingBytes = 0;
+    appendCounter = 0;
+    lastWrite = chrono::steady_clock::now();
+}
+
+void DurableStream::writeMessageToFile()
+{
+    long long started = metrics ? StreamMetrics::now() : 0;
+    if (flusher)
+    {
+        drainFlusher();
+    }
+    else
+    {
+        log->flush();
+    }
+
+    if (metrics && pendingBytes > 0)
+        metrics->recordFlush(pendingBytes, StreamMetrics::now() - started);
+    pendingBytes = 0;
+    appendCounter = 0;
+    lastWrite = chrono::steady_clock::now();
+}
+
+void DurableStream::startFlusher()
+{
+    if (policy.flushInBackground)
+    {
+        flusher = shared_ptr<BackgroundFlusher>(
+            new BackgroundFlusher(*log, policy.flushEveryMessages, policy.flushEveryMilliseconds));
+    }
+}
+
+void DurableStream::drainFlusher() const
+{
+    if (flusher)
+    {
+        flusher->barrier();
+    }
+}
+
+void DurableStream::syncSharedLog()
+{
+    if (log.use_count() > 1)
+    {
+        syncMessages();
+    }
+}
+
+void DurableStream::importLegacyFile()
+{
+    error_code error;
+    if (!filesystem::is_regular_file(filePath, error))
+        return;
+
+    ifstream legacy(filePath);
+    if (!legacy.is_open())
+        throw runtime_error("Failed to open legacy message file.");
+
+    string line;
+    while (getline(legacy, line))
+    {
+        if (isValidMessage(line))
+            log->append(line);
+    }
+    if (legacy.bad())
+        throw runtime_error("Failed to read legacy message file.");
+
+    log->flush();
+}
+
+bool DurableStream::writeDue() const
+{
+    if (policy.flushEveryMessages > 0 && appendCounter >= policy.flushEveryMessages)
+        return true;
+
+    return policy.flushEveryMilliseconds > 0
+        && chrono::steady_clock::now() - lastWrite >= chrono::milliseconds(policy.flushEveryMilliseconds);
 }
 
 bool DurableStream::isValidFilePath(const string& file) const
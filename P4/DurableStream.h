@@ -5,9 +5,15 @@
 #define DURABLESTREAM_H
 
 #include "MsgStream.h"
+#include "SegmentedLog.h"
+#include "DurabilityPolicy.h"
+#include "BackgroundFlusher.h"
+#include "IoRing.h"
 #include <memory>
 #include <string>
-#include <fstream>
+#include <string_view>
+#include <vector>
+#include <chrono>
 #include <stdexcept>
 
 using namespace std;
@@ -16,29 +22,34 @@ class DurableStream : public MsgStream
 {
     // Class invariant:
     // - DurableStream extends MsgStream with additional file I/O to persist messages both in memory and on disk.
-    // - The filePath must be a valid, non-empty path that specifies where messages are stored.
+    // - The filePath must be a valid, non-empty path prefix; messages are stored in SegmentedLog segment files derived from it.
     // - The capacity must be greater than 0, setting a limit on the number of messages stored in memory and on file.
-    // - The WRITE_THRESHOLD determines the frequency of file writes to balance efficiency with data durability.
+    // - The DurabilityPolicy determines the frequency of file writes (and whether they are fsynced) to balance
+    //   efficiency with data durability; it can differ per stream.
     // - The initialState accurately reflects the messages synced from the file, allowing reset operations to restore this state.
     // - DurableStream extends reading to both in-memory messages and any that is maintained in the backing file.
     // - Resetting will restore both in-memory and file messages to the original state of when the object was first created.
 
     private:
-        const int WRITE_THRESHOLD = 3;
+        DurabilityPolicy policy;
+        chrono::steady_clock::time_point lastWrite;
 
         string filePath;
-        ofstream outFile;
-        ifstream inFile;
-        unique_ptr<string[]> initialState;
+        shared_ptr<SegmentedLog> log;
+        shared_ptr<BackgroundFlusher> flusher;
+        vector<string> initialState;
+        int initialCount;
         int capacity;
         int appendCounter;
+        long long pendingBytes;
+        bool baselineIntact;
 
         // Preconditions:
         // - other must be a valid DurableStream object with initialized members.
         // - other must have a valid file path and in-memory storage state to copy from.
         // Postconditions:
         // - Current object is deeply copied with its own unique in-memory messages and file path.
-        // - All applicable and current resources are copied over to the target object.
+        // - The copy shares other's log handle (and background flusher), so both append to one writer.
         DurableStream(const DurableStream& other);
 
         // Preconditions:
@@ -48,7 +59,8 @@ class DurableStream : public MsgStream
         // - Checks for self assignment initially; if true, returns *this unchanged.
         // - The current DurableStream object is deeply copied from "other" with its own unique in-memory message storage and file path.
         // - "messages", "initialState", and "filePath" are all copied to ensure the new object has an independent, consistent state.
-        // - Any previously stored data in the current object is replaced by the other objects data, with exclusive ownership of all resources.
+        // - Any previously stored data in the current object is replaced by the other objects data; the log handle and
+        //   background flusher are shared with other, as for the copy constructor.
         DurableStream& operator=(const DurableStream& other);
 
         // Preconditions:
@@ -67,19 +79,44 @@ class DurableStream : public MsgStream
         DurableStream& operator=(DurableStream&& other) noexcept;
 
         // Preconditions:
-        // - filePath must be a valid and readable file path.
+        // - log must be open on filePath.
         // - object and capacity must have valid state.
         // Postconditions:
-        // - Synchronizes messages from filePath into in-memory message storage
-        // - Populates initialState array with synced messages to preserve original state for reset
+        // - Scans only the log tail written since the last sync and appends records beyond messageCount
+        //   (written by other streams sharing filePath) to in-memory storage, seeking directly to the first
+        //   unseen message number. The cost is proportional to the new data, not the file size.
+        // - If the log was truncated or replaced, in-memory storage is rebuilt from the log.
+        // - Synced messages do not count against the operation limit.
         void syncMessages();
 
         // Preconditions:
-        // - messages must be valid containing at least the write threshold messages
+        // - log must be open on filePath.
         // Postconditions:
-        // - The messagess are appeneded to the file.
-        void writeMessageToFile(unique_ptr<string[]> messages);
-        unique_ptr<string[]> getLastMessages(int count) const;
+        // - The records buffered in the log since the last write are written to the active segment in one write call,
+        //   fsynced if the policy asks for it; append counter and last write time are reset.
+        void writeMessageToFile();
+
+        // Postconditions:
+        // - A BackgroundFlusher is started on log if the policy asks for background writes.
+        void startFlusher();
+
+        // Postconditions:
+        // - If a flusher runs, every record handed to it is in the log and the log may be used on this thread.
+        void drainFlusher() const;
+
+        // Postconditions:
+        // - If a copy shares log, records it appended are synced into in-memory storage first, so the next append
+        //   gets the in-memory position matching its message number in the log.
+        void syncSharedLog();
+
+        // Preconditions:
+        // - log was just created, so it holds no messages.
+        // Postconditions:
+        // - If filePath is a message file in the old line-per-message format, its messages are appended to log in
+        //   order and flushed, skipping lines the old reader skipped (invalid messages). The old file is left as it is.
+        // - Throws runtime_error if the old file cannot be read.
+        void importLegacyFile();
+        bool writeDue() const;
         bool isValidFilePath(const string& file) const;
 
     public:
@@ -88,17 +125,47 @@ class DurableStream : public MsgStream
         // - filePath must be a valid, non-empty string, pointing to a readable and writable file location.
         // Postconditions:
         // - Instantiated with initialized in-memory message storage and an associated file for persistence.
-        // - If the file at file path exists, its contents are synced to the in-memory storage.
+        // - If the file at file path exists, the log is recovered first: a torn or corrupt tail left by a crash is
+        //   truncated, and the in-memory storage is rebuilt from the valid records (the first capacity of them).
+        // - Opening a log closed cleanly or snapshotted recently replays only the records written after its snapshot.
+        // - Messages live in segment files named after filePath, not in the file at filePath itself; that file was the
+        //   old line-per-message format. If no log exists yet but that file does, its messages are imported into the
+        //   new log on this first open, and later opens use the log only.
         // - The initialState is set to match the original file content, supporting reset functionality.
         DurableStream(int capacity, const string& filePath);
 
+        // Preconditions:
+        // - Same as above; policy must be a valid DurabilityPolicy.
+        // Postconditions:
+        // - Same as above, with buffered records written according to policy instead of the default.
+        DurableStream(int capacity, const string& filePath, const DurabilityPolicy& policy);
+
+        // Postconditions:
+        // - Returns a deep copy that shares this stream's log handle, so appends through either reach one writer in
+        //   order and each sees the other's messages on its next read or append.
+        // - The two must not be used concurrently, and neither may change its durability policy while both exist.
+        unique_ptr<MsgStream> clone() const override;
+
         // Preconditions:
         // - The message must be a valid string and pass vaild message check.
         // - Stream must not be full and operation limit must not be reached.
         // Postconditions:
         // - message is appended to in-memory storage if valid
-        // - if the write threshold is reached, those messages are written to the file, and append counter is reset.
-        void appendMessage(const string& message) override;
+        // - message is framed into the log's write buffer.
+        // - if the durability policy's count or time trigger fires, the buffered records are written to the file,
+        //   and append counter is reset.
+        // - With a background policy the message is only copied into the flusher's queue; the write happens on the
+        //   flusher's thread.
+        void appendMessage(string_view message) override;
+
+        // Preconditions:
+        // - As for MsgStream::appendBatch.
+        // Postconditions:
+        // - All messages are appended in memory and framed into the log's write buffer, or none are.
+        // - The durability policy is checked once for the whole batch, so a batch reaches the file in at most one
+        //   write call (and one fsync when the policy asks for it) however many messages it holds.
+        void appendBatch(const string_view* batch, int count) override;
+        using MsgStream::appendBatch;
 
         // Preconditions:
         // - start and end range must be a valid range with current message count.
@@ -106,25 +173,86 @@ class DurableStream : public MsgStream
         // Postconditions:
         // - in-memory storage is up-to-date by syncing messages from the file.
         // - Returns a pointer containing messages within the specified range from in-memory storage.
-        unique_ptr<string[]> readMessages(int startRange, int endRange) override;
+        unique_ptr<string[]> readMessages(long long startRange, long long endRange) override;
+
+        // Preconditions:
+        // - The range [startRange, endRange) must be valid with the current message count after syncing.
+        // Postconditions:
+        // - in-memory storage is synced from the file, then a non-owning view of the range is returned.
+        // - The view expires with the epoch, which also advances when a sync finds the log truncated.
+        MessageRange viewMessages(long long startRange, long long endRange) override;
+
+        // Preconditions:
+        // - The range [startRange, endRange) must lie within the backing log, which may hold more messages than capacity.
+        // - Operation count must not exceed the operation limit.
+        // Postconditions:
+        // - The log is synced and views of the requested messages are returned straight from memory-mapped
+        //   segment files; message bytes are neither copied nor held in in-memory storage.
+        // - Views remain valid until reset, a sync that finds the log truncated, or destruction of the stream.
+        vector<string_view> readMessageViews(long long startRange, long long endRange);
 
         // Preconditions:
         // - initialState must contain original messages from the file or be initialized.
         // - filePath must be valid and writable.
         // Postconditions:
         // - in-memory messages are cleared and restored to initialState.
-        // - filePath is cleared and rewritten; append counter is reset
+        // - the log is truncated back to the initial messages at a cost bounded by one segment, whatever its size;
+        //   other streams on filePath notice on their next sync. Only if it was replaced since is it cleared and
+        //   rewritten with initialState. append counter is reset
         void reset() override;
 
+        // Postconditions:
+        // - Every message appended so far has been written to the log (and fsynced if the policy syncs), whether it
+        //   was buffered on this thread or queued for the background flusher; returns once it is there.
+        void flush();
+
+        // Postconditions:
+        // - The records buffered since the last write are queued on ring rather than written, so many streams can
+        //   share one batch of system calls; ring must be submitted before this stream is used again.
+        // - With a background flusher the flusher is drained instead and nothing is queued.
+        void queueWrite(IoRing& ring);
+
+        // Postconditions:
+        // - policy replaces the current durability policy and applies from the next append; records queued for a
+        //   background flusher are written first if the new policy stops or restarts it.
+        // - Throws runtime_error if a copy shares the log, since the policy and flusher belong to the shared writer.
+        void setDurabilityPolicy(const DurabilityPolicy& policy);
+        DurabilityPolicy getDurabilityPolicy() const;
+        long long getLogMessageCount() const;
+
+        // Postconditions:
+        // - Returns what opening the backing log found and repaired, including how long recovery took.
+        RecoveryReport getRecoveryReport() const;
+
     // Implementation invariant:
     // - DurableStream leverages MsgStream for core message storage and management.
     // - The capacity must remain above 0, ensuring DurableStream has space for message storage.
     // - The filePath must point to a readable and writable file, used consistently for data synchronization.
-    // - The WRITE_THRESHOLD ensures that the file isn’t written on each append, optimizing I/O performance.
+    // - The DurabilityPolicy ensures that the file isn’t written on each append, optimizing I/O performance;
+    //   records accumulate in the log's write buffer and reach the segment in a single write (a group commit
+    //   when syncOnFlush is set). The time trigger is evaluated on append, so it bounds the age of buffered
+    //   records only while the stream keeps receiving messages.
+    // - appendBatch frames a whole batch before consulting the policy, so the count trigger may be overshot by up to
+    //   one batch; the overshoot is written in the same call rather than split across two.
+    // - messageCount never exceeds the log's message count, so every in-memory message has a durable record
+    //   (or a buffered one) at the same message number.
     // - The initialState holds the initial file-synced messages, supporting consistent reset behavior and enabling accurate deep copies.
-    // - Copy and move operations have been suppressed to ensure each DurableStream instance is uniquely owned and manages its
-    //   own file, maintaining data integrity, and avoiding resource contention.
-    // - unique_ptr<string[]> messages provides exclusive ownership of in-memory messages to ensure safe and automatic memory management.
+    // - baselineIntact is true while the log's first initialCount records are still the ones initialState was read from;
+    //   it turns false when a sync finds the log truncated or replaced, and reset then rewrites the log instead.
+    // - Copies share the SegmentedLog (and flusher) of their original instead of opening a second writer on the same
+    //   segment files, which would assign the same message numbers twice. A stream whose log is shared syncs before
+    //   every append, so messageCount equals the log's count when it appends; a sync that finds fewer records in
+    //   the log than in memory (a copy reset or cleared it) rebuilds in-memory storage as a truncation does.
+    // - Copy and move operations are private, so copies are made only through clone.
+    // - readMessageViews coexists with the buffered append path: it flushes pending records before mapping, and the
+    //   mapped read path never materialises messages in the heap, so read-heavy partitions can scan the whole log.
+    // - The inherited MessageArena provides exclusive ownership of in-memory messages to ensure safe and automatic memory management.
+    // - pendingBytes counts the message bytes appended since the last write to the file, for the flush metrics. With
+    //   metrics enabled, appends and reads are timed by MsgStream, so their latency covers the in-memory work only;
+    //   writes to the file are timed as flushes, and every sync (even one that finds nothing new) as a sync, because
+    //   reads pay for it. Writes queued on an IoRing are counted without a latency sample.
+    // - flusher exists exactly when the policy is a background one. Every path that touches log other than appending
+    //   drains it first, and it is declared after log so it is stopped before the log it writes to is closed.
 };
 
 #endif
\ No newline at end of file
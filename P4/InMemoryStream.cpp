@@ -0,0 +1,25 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#include "InMemoryStream.h"
+#include "MsgStream.h"
+#include <memory>
+#include <utility>
+
+using namespace std;
+
+InMemoryStream::InMemoryStream(int capacity) : MsgStream(capacity) {}
+
+InMemoryStream::InMemoryStream(int capacity, CapacityMode mode) : MsgStream(capacity, mode) {}
+
+InMemoryStream::InMemoryStream(int capacity, CapacityMode mode, const RetentionPolicy& retention)
+    : MsgStream(capacity, mode, retention) {}
+
+InMemoryStream::InMemoryStream() : MsgStream() {}
+
+InMemoryStream::InMemoryStream(MsgStream&& stream) noexcept : MsgStream(move(stream)) {}
+
+unique_ptr<MsgStream> InMemoryStream::clone() const
+{
+    return unique_ptr<MsgStream>(new InMemoryStream(*this));
+}
@@ -0,0 +1,50 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#ifndef INMEMORYSTREAM_H
+#define INMEMORYSTREAM_H
+
+#include "MsgStream.h"
+#include "RetentionPolicy.h"
+#include <memory>
+
+using namespace std;
+
+class InMemoryStream final : public MsgStream
+{
+    // Class invariant:
+    // - InMemoryStream is a MsgStream that keeps its messages in memory only and behaves exactly like one.
+    // - It is final, so code that holds one by its own type calls appendMessage, readMessages, viewMessages,
+    //   appendBatch and reset directly instead of through the vtable, and the compiler may inline them.
+    // - Code that holds it as a MsgStream still sees the virtual interface, so it mixes freely with DurableStream
+    //   and other derived streams.
+
+    public:
+        // Preconditions:
+        // - As for the MsgStream constructors with the same arguments.
+        // Postconditions:
+        // - An empty stream with the given capacity, mode and retention is created.
+        InMemoryStream(int capacity);
+        InMemoryStream(int capacity, CapacityMode mode);
+        InMemoryStream(int capacity, CapacityMode mode, const RetentionPolicy& retention);
+
+        // Postconditions:
+        // - Creates an empty stream with no capacity, like MsgStream().
+        InMemoryStream();
+
+        // Preconditions:
+        // - stream must be a plain MsgStream; the parts of a derived stream beyond MsgStream are not moved.
+        // Postconditions:
+        // - The new stream takes over stream's messages, limits, budget and metrics, leaving stream empty.
+        InMemoryStream(MsgStream&& stream) noexcept;
+
+        // Postconditions:
+        // - Returns an independent deep copy that is an InMemoryStream too.
+        unique_ptr<MsgStream> clone() const override;
+};
+
+// Implementation invariant:
+// - InMemoryStream adds no state and overrides nothing but clone, so every operation is MsgStream's own and the
+//   stream costs exactly what a MsgStream does; the compiler-generated copy and move operations are MsgStream's.
+
+#endif
@@ -0,0 +1,344 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#include "IoRing.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <stdexcept>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+    unsigned* field(void* ring, uint32_t offset)
+    {
+        return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset);
+    }
+}
+
+IoRing::IoRing(unsigned entries, bool useUring)
+    : ringFd(-1), entries(entries), systemCalls(0), submissionRing(nullptr), submissionRingSize(0),
+      completionRing(nullptr), completionRingSize(0), submissionEntries(nullptr), submissionEntriesSize(0),
+      submissionTail(nullptr), submissionMask(nullptr), submissionArray(nullptr), completionHead(nullptr),
+      completionTail(nullptr), completionMask(nullptr), completionEntries(nullptr)
+{
+    // A synced write takes two linked entries, so a smaller ring could never submit one.
+    if (entries < 2)
+        throw invalid_argument("Invalid ring size.");
+
+    if (useUring && !setUp(entries))
+    {
+        release();
+    }
+}
+
+IoRing::~IoRing()
+{
+    release();
+}
+
+void IoRing::queueWrite(int fd, string& data, bool syncAfter,
+    function<void(bool completed, string& unwritten)> done)
+{
+    Operation operation = { fd, string(), syncAfter, 0, false, move(done) };
+    if (!spareBuffers.empty())
+    {
+        operation.data = move(spareBuffers.back());
+        spareBuffers.pop_back();
+    }
+    swap(operation.data, data);
+    queued.push_back(move(operation));
+}
+
+void IoRing::submit()
+{
+    if (queued.empty())
+        return;
+
+    try
+    {
+        if (ringFd >= 0)
+        {
+            submitWithUring();
+        }
+        else
+        {
+            submitWithPwrite();
+        }
+    }
+    catch (...)
+    {
+        for (Operation& operation : queued)
+        {
+            report(operation);
+        }
+        queued.clear();
+        throw;
+    }
+
+    for (Operation& operation : queued)
+    {
+        report(operation);
+        operation.data.clear();
+        spareBuffers.push_back(move(operation.data));
+    }
+    queued.clear();
+}
+
+bool IoRing::usesUring() const
+{
+    return ringFd >= 0;
+}
+
+long long IoRing::getSystemCalls() const
+{
+    return systemCalls;
+}
+
+bool IoRing::setUp(unsigned requested)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    long fd = ::syscall(__NR_io_uring_setup, requested, &params);
+    if (fd < 0)
+        return false;
+    ringFd = static_cast<int>(fd);
+
+    // IORING_OP_WRITE arrived with the same kernel as this feature flag.
+    if (!(params.features & IORING_FEAT_RW_CUR_POS))
+        return false;
+
+    entries = params.sq_entries;
+    submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMapping)
+    {
+        submissionRingSize = max(submissionRingSize, completionRingSize);
+    }
+
+    submissionRing = ::mmap(nullptr, submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ringFd, IORING_OFF_SQ_RING);
+    if (submissionRing == MAP_FAILED)
+    {
+        submissionRing = nullptr;
+        return false;
+    }
+
+    if (singleMapping)
+    {
+        completionRing = submissionRing;
+        completionRingSize = 0;
+    }
+    else
+    {
+        completionRing = ::mmap(nullptr, completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ringFd, IORING_OFF_CQ_RING);
+        if (completionRing == MAP_FAILED)
+        {
+            completionRing = nullptr;
+            return false;
+        }
+    }
+
+    submissionEntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, submissionEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ringFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+        return false;
+    submissionEntries = static_cast<io_uring_sqe*>(sqes);
+
+    submissionTail = field(submissionRing, params.sq_off.tail);
+    submissionMask = field(submissionRing, params.sq_off.ring_mask);
+    submissionArray = field(submissionRing, params.sq_off.array);
+    completionHead = field(completionRing, params.cq_off.head);
+    completionTail = field(completionRing, params.cq_off.tail);
+    completionMask = field(completionRing, params.cq_off.ring_mask);
+    completionEntries = reinterpret_cast<io_uring_cqe*>(static_cast<char*>(completionRing) + params.cq_off.cqes);
+    return true;
+}
+
+void IoRing::release()
+{
+    if (submissionEntries)
+        ::munmap(submissionEntries, submissionEntriesSize);
+    if (completionRing && completionRing != submissionRing)
+        ::munmap(completionRing, completionRingSize);
+    if (submissionRing)
+        ::munmap(submissionRing, submissionRingSize);
+    if (ringFd >= 0)
+        ::close(ringFd);
+
+    ringFd = -1;
+    submissionRing = nullptr;
+    completionRing = nullptr;
+    submissionEntries = nullptr;
+}
+
+void IoRing::submitWithUring()
+{
+    size_t next = 0;
+    while (next < queued.size())
+    {
+        // The kernel has consumed every earlier entry, so the whole submission queue is free.
+        unsigned batchEntries = 0;
+        size_t first = next;
+        while (next < queued.size() && batchEntries + (queued[next].syncAfter ? 2 : 1) <= entries)
+        {
+            const Operation& operation = queued[next];
+            pushEntry(IORING_OP_WRITE, operation, next * 2, operation.syncAfter);
+            batchEntries++;
+            if (operation.syncAfter)
+            {
+                pushEntry(IORING_OP_FSYNC, operation, next * 2 + 1, false);
+                batchEntries++;
+            }
+            next++;
+        }
+
+        enter(batchEntries, batchEntries);
+
+        unsigned head = *completionHead;
+        unsigned tail = __atomic_load_n(completionTail, __ATOMIC_ACQUIRE);
+        string error;
+        for (; head != tail; head++)
+        {
+            const io_uring_cqe& completion = completionEntries[head & *completionMask];
+            Operation& operation = queued[completion.user_data / 2];
+            bool sync = completion.user_data % 2 == 1;
+
+            if (completion.res < 0 && completion.res != -ECANCELED)
+            {
+                error = sync ? "Failed to sync log segment." : "Failed to write to log segment.";
+            }
+            else if (sync)
+            {
+                operation.synced = completion.res == 0;
+            }
+            else
+            {
+                operation.written = max<long long>(completion.res, 0);
+            }
+        }
+        __atomic_store_n(completionHead, head, __ATOMIC_RELEASE);
+
+        if (!error.empty())
+            throw runtime_error(error);
+
+        for (size_t i = first; i < next; i++)
+        {
+            finish(queued[i]);
+        }
+    }
+}
+
+void IoRing::submitWithPwrite()
+{
+    for (Operation& operation : queued)
+    {
+        systemCalls += operation.syncAfter ? 2 : 1;
+        finish(operation);
+    }
+}
+
+void IoRing::enter(unsigned toSubmit, unsigned toComplete)
+{
+    unsigned submitted = 0;
+    while (true)
+    {
+        unsigned ready = __atomic_load_n(completionTail, __ATOMIC_ACQUIRE) - *completionHead;
+        if (submitted == toSubmit && ready >= toComplete)
+            return;
+
+        systemCalls++;
+        long result = ::syscall(__NR_io_uring_enter, ringFd, toSubmit - submitted, toComplete,
+            IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (result < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                continue;
+            throw runtime_error("Failed to submit log writes.");
+        }
+        submitted += static_cast<unsigned>(result);
+    }
+}
+
+void IoRing::finish(Operation& operation)
+{
+    long long length = static_cast<long long>(operation.data.size());
+    if (operation.written < length)
+    {
+        operation.synced = false;
+    }
+    while (operation.written < length)
+    {
+        ssize_t written = ::write(operation.fd, operation.data.data() + operation.written,
+            length - operation.written);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw runtime_error("Failed to write to log segment.");
+        }
+        operation.written += written;
+    }
+
+    if (operation.syncAfter && !operation.synced)
+    {
+        if (::fdatasync(operation.fd) != 0)
+            throw runtime_error("Failed to sync log segment.");
+        operation.synced = true;
+    }
+}
+
+void IoRing::report(Operation& operation)
+{
+    if (!operation.done)
+        return;
+
+    bool completed = operation.written == static_cast<long long>(operation.data.size())
+        && (!operation.syncAfter || operation.synced);
+    operation.data.erase(0, static_cast<size_t>(operation.written));
+    operation.done(completed, operation.data);
+}
+
+void IoRing::pushEntry(uint8_t opcode, const Operation& operation, uint64_t userData, bool linked)
+{
+    unsigned tail = *submissionTail;
+    unsigned index = tail & *submissionMask;
+
+    io_uring_sqe& entry = submissionEntries[index];
+    memset(&entry, 0, sizeof(entry));
+    entry.opcode = opcode;
+    entry.fd = operation.fd;
+    entry.user_data = userData;
+    if (opcode == IORING_OP_FSYNC)
+    {
+        entry.fsync_flags = IORING_FSYNC_DATASYNC;
+    }
+    else
+    {
+        entry.addr = reinterpret_cast<uint64_t>(operation.data.data());
+        entry.len = static_cast<uint32_t>(operation.data.size());
+        entry.off = static_cast<uint64_t>(-1);
+    }
+    if (linked)
+    {
+        entry.flags = IOSQE_IO_LINK;
+    }
+
+    submissionArray[index] = index;
+    __atomic_store_n(submissionTail, tail + 1, __ATOMIC_RELEASE);
+}
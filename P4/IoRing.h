@@ -0,0 +1,128 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#ifndef IORING_H
+#define IORING_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <stdexcept>
+
+using namespace std;
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+class IoRing
+{
+    // Class invariant:
+    // - IoRing collects file writes from many logs and performs them together: with io_uring, a batch of up to
+    //   entries writes (each optionally followed by an fdatasync) costs a single io_uring_enter system call.
+    // - When io_uring is unavailable (old kernel, seccomp, or useUring false) the same writes are performed with
+    //   write and fdatasync, so callers never need to know which backend ran.
+    // - Every write is an append: the files are opened with O_APPEND, so the bytes land at the end of the file
+    //   whatever position it was last written at.
+    // - Queued writes own their bytes until submit returns. A write and its sync are ordered; writes to different
+    //   files are not ordered with respect to each other.
+    // - IoRing is not thread-safe; callers serialise queueWrite and submit.
+    // - Clients must be prepared to handle runtime_error on I/O failures.
+
+    public:
+        static const unsigned DEFAULT_ENTRIES = 256;
+
+        // Preconditions:
+        // - entries must be at least 2, room for one write and its sync; otherwise invalid_argument is thrown.
+        // Postconditions:
+        // - Sets up an io_uring with room for entries submissions if useUring is set and the kernel allows it;
+        //   otherwise the ring falls back to write.
+        explicit IoRing(unsigned entries = DEFAULT_ENTRIES, bool useUring = true);
+
+        // Postconditions:
+        // - The ring and its mappings are released. Writes still queued are dropped.
+        ~IoRing();
+
+        // Preconditions:
+        // - fd must be open with O_APPEND and stay open until submit returns. Writes to one file queued for the same
+        //   submit may land in either order, so at most one should be queued per file.
+        // - done, if given, must not throw and must stay callable until submit returns.
+        // Postconditions:
+        // - data is queued for writing and left empty, swapped with a recycled buffer so the caller keeps its
+        //   allocation. With syncAfter set, the file is fdatasynced once the write completes.
+        // - submit calls done exactly once: done(true, ...) once the write (and its sync) completed, or
+        //   done(false, unwritten) if it did not, with the bytes that never reached the file, so the caller can
+        //   take them back and retry.
+        void queueWrite(int fd, string& data, bool syncAfter,
+            function<void(bool completed, string& unwritten)> done = nullptr);
+
+        // Postconditions:
+        // - Every queued write (and sync) has completed, in as few system calls as the ring size allows, and each
+        //   has been reported to its done callback.
+        // - Throws runtime_error if any of them failed, after reporting every write as completed or not; the queue
+        //   is empty either way.
+        void submit();
+
+        bool usesUring() const;
+        long long getSystemCalls() const;
+
+    private:
+        struct Operation
+        {
+            int fd;
+            string data;
+            bool syncAfter;
+            long long written;
+            bool synced;
+            function<void(bool completed, string& unwritten)> done;
+        };
+
+        int ringFd;
+        unsigned entries;
+        vector<Operation> queued;
+        vector<string> spareBuffers;
+        long long systemCalls;
+
+        void* submissionRing;
+        size_t submissionRingSize;
+        void* completionRing;
+        size_t completionRingSize;
+        io_uring_sqe* submissionEntries;
+        size_t submissionEntriesSize;
+
+        unsigned* submissionTail;
+        unsigned* submissionMask;
+        unsigned* submissionArray;
+        unsigned* completionHead;
+        unsigned* completionTail;
+        unsigned* completionMask;
+        io_uring_cqe* completionEntries;
+
+        IoRing(const IoRing& other);
+        IoRing& operator=(const IoRing& other);
+
+        bool setUp(unsigned requested);
+        void release();
+        void submitWithUring();
+        void submitWithPwrite();
+        void enter(unsigned toSubmit, unsigned toComplete);
+        void finish(Operation& operation);
+        void report(Operation& operation);
+        void pushEntry(uint8_t opcode, const Operation& operation, uint64_t userData, bool linked);
+};
+
+// Implementation invariant:
+// - ringFd is -1 exactly when the write fallback is in use; the mapped regions are valid only while it is open.
+// - A submit fills the submission queue with as many queued writes as fit (two entries for a synced write, linked so
+//   the sync starts only after the write succeeds), enters the kernel once to submit them and wait for all of their
+//   completions, and repeats until the queue is empty. The completion queue is twice the submission queue, so
+//   waiting for a whole batch never overflows it.
+// - user_data is the operation index times two, plus one for its sync. A short write breaks the link and cancels the
+//   sync, so finish completes the rest of such a write, and any sync that did not succeed, with write and fdatasync.
+// - Entries carry no offset (off is -1, the file position), and O_APPEND moves that to the end of the file first.
+// - written counts the bytes of an operation known to be in the file, and finish advances it as each write lands,
+//   so after a failure report hands back exactly the bytes that are missing and a retry never duplicates any.
+// - Buffers of completed writes are cleared and kept in spareBuffers, so steady-state flushing allocates nothing.
+
+#endif
@@ -0,0 +1,284 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#include "MessageArena.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <stdexcept>
+
+using namespace std;
+
+MessageArena::MessageArena() : MessageArena(0, false, 0) {}
+
+MessageArena::MessageArena(int capacity) : MessageArena(capacity, false, 0) {}
+
+MessageArena::MessageArena(int capacity, bool evictOldest, size_t byteLimit)
+    : published(0), capacity(capacity), count(0), head(0), currentChunk(-1), firstOffset(0),
+      evictOldest(evictOldest), byteLimit(byteLimit), liveBytes(0)
+{
+    if (capacity < 0)
+        throw invalid_argument("Invalid arena capacity.");
+}
+
+MessageArena::MessageArena(const MessageArena& other)
+    : freeChunks(other.freeChunks), published(other.count), capacity(other.capacity), count(other.count), head(other.head),
+      currentChunk(other.currentChunk), firstOffset(other.firstOffset), evictOldest(other.evictOldest),
+      byteLimit(other.byteLimit), liveBytes(other.liveBytes)
+{
+    // Slots refer to chunks by index, so every chunk is copied in place, each trimmed to its bytes in use.
+    // Free chunks have nothing in use and are copied as empty placeholders.
+    for (const Chunk& source : other.chunks)
+    {
+        Chunk chunk = { unique_ptr<char[]>(new char[source.used]), source.used, source.used };
+        if (source.used > 0)
+        {
+            memcpy(chunk.bytes.get(), source.bytes.get(), source.used);
+        }
+        chunkDirectory.push(chunk.bytes.get());
+        chunks.push_back(move(chunk));
+    }
+
+    for (size_t block = 0; block < other.slotBlocks.size(); block++)
+    {
+        int size = slotBlockSize(block);
+        slotBlocks.push_back(unique_ptr<Slot[]>(new Slot[size]));
+        memcpy(slotBlocks.back().get(), other.slotBlocks[block].get(), size * sizeof(Slot));
+        slotDirectory.push(slotBlocks.back().get());
+    }
+}
+
+MessageArena& MessageArena::operator=(const MessageArena& other)
+{
+    if (this == &other) return *this;
+
+    MessageArena copy(other);
+    *this = move(copy);
+
+    return *this;
+}
+
+MessageArena::MessageArena(MessageArena&& other) noexcept
+    : chunks(move(other.chunks)), freeChunks(move(other.freeChunks)), slotBlocks(move(other.slotBlocks)),
+      slotDirectory(move(other.slotDirectory)), chunkDirectory(move(other.chunkDirectory)),
+      published(other.count), capacity(other.capacity), count(other.count), head(other.head), currentChunk(other.currentChunk),
+      firstOffset(other.firstOffset), evictOldest(other.evictOldest), byteLimit(other.byteLimit),
+      liveBytes(other.liveBytes)
+{
+    other.chunks.clear();
+    other.freeChunks.clear();
+    other.slotBlocks.clear();
+    other.published.store(0, memory_order_relaxed);
+    other.capacity = 0;
+    other.count = 0;
+    other.head = 0;
+    other.currentChunk = -1;
+    other.firstOffset = 0;
+    other.liveBytes = 0;
+}
+
+MessageArena& MessageArena::operator=(MessageArena&& other) noexcept
+{
+    if (this == &other) return *this;
+
+    chunks = move(other.chunks);
+    freeChunks = move(other.freeChunks);
+    slotBlocks = move(other.slotBlocks);
+    slotDirectory = move(other.slotDirectory);
+    chunkDirectory = move(other.chunkDirectory);
+    published.store(other.count, memory_order_relaxed);
+    capacity = other.capacity;
+    count = other.count;
+    head = other.head;
+    currentChunk = other.currentChunk;
+    firstOffset = other.firstOffset;
+    evictOldest = other.evictOldest;
+    byteLimit = other.byteLimit;
+    liveBytes = other.liveBytes;
+
+    other.chunks.clear();
+    other.freeChunks.clear();
+    other.slotBlocks.clear();
+    other.published.store(0, memory_order_relaxed);
+    other.capacity = 0;
+    other.count = 0;
+    other.head = 0;
+    other.currentChunk = -1;
+    other.firstOffset = 0;
+    other.liveBytes = 0;
+
+    return *this;
+}
+
+int MessageArena::append(string_view message)
+{
+    if (message.size() > MAX_MESSAGE_SIZE)
+        throw invalid_argument("Message exceeds maximum arena message size.");
+
+    if (byteLimit > 0 && message.size() > byteLimit)
+        throw invalid_argument("Message exceeds arena byte limit.");
+
+    if (capacity == 0 || (!evictOldest && count >= capacity))
+        throw runtime_error("Arena capacity has been reached.");
+
+    if (!evictOldest && byteLimit > 0 && liveBytes + message.size() > byteLimit)
+        throw runtime_error("Arena byte limit has been reached.");
+
+    int evicted = 0;
+    while (count > 0 && (count >= capacity || (byteLimit > 0 && liveBytes + message.size() > byteLimit)))
+    {
+        evictOldestMessage();
+        evicted++;
+    }
+
+    if (currentChunk < 0 || chunks[currentChunk].size - chunks[currentChunk].used < message.size())
+    {
+        // The abandoned chunk keeps its messages until they are evicted; if none are left it is free already.
+        if (currentChunk >= 0 && (count == 0 || slotAt(count - 1).chunk != static_cast<uint32_t>(currentChunk)))
+        {
+            releaseChunk(currentChunk);
+        }
+        currentChunk = takeChunk(message.size());
+    }
+
+    int position = head + count;
+    if (position >= capacity)
+    {
+        position -= capacity;
+    }
+    int block = position >> SLOT_BLOCK_BITS;
+    while (block >= static_cast<int>(slotBlocks.size()))
+    {
+        slotBlocks.push_back(unique_ptr<Slot[]>(new Slot[slotBlockSize(slotBlocks.size())]()));
+        slotDirectory.push(slotBlocks.back().get());
+    }
+
+    Chunk& chunk = chunks[currentChunk];
+    if (!message.empty())
+    {
+        memcpy(chunk.bytes.get() + chunk.used, message.data(), message.size());
+    }
+
+    Slot slot = { static_cast<uint32_t>(currentChunk), static_cast<uint16_t>(chunk.used), static_cast<uint16_t>(message.size()) };
+    slotBlocks[block][position & (SLOT_BLOCK_SIZE - 1)] = slot;
+
+    chunk.used += message.size();
+    liveBytes += message.size();
+    count++;
+    published.store(count, memory_order_release);
+
+    return evicted;
+}
+
+void MessageArena::clear()
+{
+    freeChunks.clear();
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        chunks[i].used = 0;
+        freeChunks.push_back(static_cast<int>(i));
+    }
+    count = 0;
+    head = 0;
+    currentChunk = -1;
+    firstOffset = 0;
+    liveBytes = 0;
+    published.store(0, memory_order_release);
+}
+
+int MessageArena::size() const
+{
+    return count;
+}
+
+int MessageArena::getCapacity() const
+{
+    return capacity;
+}
+
+long long MessageArena::getFirstOffset() const
+{
+    return firstOffset;
+}
+
+size_t MessageArena::bytesUsed() const
+{
+    return liveBytes;
+}
+
+size_t MessageArena::bytesReserved() const
+{
+    size_t reserved = 0;
+    for (const Chunk& chunk : chunks)
+    {
+        reserved += chunk.size;
+    }
+    for (size_t block = 0; block < slotBlocks.size(); block++)
+    {
+        reserved += slotBlockSize(block) * sizeof(Slot);
+    }
+    return reserved;
+}
+
+int MessageArena::slotBlockSize(int block) const
+{
+    return min(SLOT_BLOCK_SIZE, capacity - (block << SLOT_BLOCK_BITS));
+}
+
+void MessageArena::evictOldestMessage()
+{
+    uint32_t chunk = slotAt(0).chunk;
+    liveBytes -= slotAt(0).length;
+
+    head++;
+    if (head == capacity)
+    {
+        head = 0;
+    }
+    count--;
+    firstOffset++;
+    published.store(count, memory_order_release);
+
+    if (static_cast<int>(chunk) != currentChunk && (count == 0 || slotAt(0).chunk != chunk))
+    {
+        releaseChunk(chunk);
+    }
+}
+
+void MessageArena::releaseChunk(int chunk)
+{
+    chunks[chunk].used = 0;
+    freeChunks.push_back(chunk);
+}
+
+int MessageArena::takeChunk(size_t required)
+{
+    for (size_t i = 0; i < freeChunks.size(); i++)
+    {
+        int chunk = freeChunks[i];
+        if (chunks[chunk].size >= required)
+        {
+            freeChunks[i] = freeChunks.back();
+            freeChunks.pop_back();
+            return chunk;
+        }
+    }
+
+    // Each new chunk doubles the previous one, so the size follows from how many chunks exist already.
+    uint32_t size = MAX_CHUNK_SIZE;
+    if (chunks.size() < CHUNK_DOUBLINGS)
+    {
+        size = FIRST_CHUNK_SIZE << chunks.size();
+    }
+    size = max(size, static_cast<uint32_t>(required));
+
+    Chunk chunk = { unique_ptr<char[]>(new char[size]), size, 0 };
+    chunkDirectory.push(chunk.bytes.get());
+    chunks.push_back(move(chunk));
+    return static_cast<int>(chunks.size()) - 1;
+}
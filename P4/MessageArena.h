@@ -0,0 +1,172 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#ifndef MESSAGEARENA_H
+#define MESSAGEARENA_H
+
+#include "PublishedDirectory.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <stdexcept>
+
+using namespace std;
+
+class MessageArena
+{
+    // Class invariant:
+    // - MessageArena stores up to capacity messages packed back-to-back in a list of byte chunks.
+    // - Chunks are allocated as messages arrive and are never relocated or resized, so a view of a stored message
+    //   stays valid for as long as the message is stored, no matter how many messages are appended after it.
+    // - Each message is described by a Slot (chunk, offset, length); slots live in fixed-size blocks that are
+    //   also allocated on demand and never relocated.
+    // - Messages are only ever appended at the end, evicted from the front, or cleared all at once; stored bytes are
+    //   never modified in place.
+    // - A message never spans two chunks and may be at most MAX_MESSAGE_SIZE bytes long.
+    // - An evicting arena never fills up: appending to a full arena (or past byteLimit) evicts the oldest messages,
+    //   and a chunk whose messages have all been evicted is recycled for new ones, so memory stays bounded.
+    // - Messages are indexed from the oldest retained one; getFirstOffset() is the number of messages evicted so far.
+    // - One writer may append while any number of readers call publishedSize() and operator[] on indices below it,
+    //   without locks, provided the arena does not evict. Every other member is for the writer only.
+
+    private:
+        struct Slot
+        {
+            uint32_t chunk;
+            uint16_t offset;
+            uint16_t length;
+        };
+
+        struct Chunk
+        {
+            unique_ptr<char[]> bytes;
+            uint32_t size;
+            uint32_t used;
+        };
+
+        static constexpr int SLOT_BLOCK_BITS = 10;
+        static constexpr int SLOT_BLOCK_SIZE = 1 << SLOT_BLOCK_BITS;
+        static constexpr uint32_t FIRST_CHUNK_SIZE = 256;
+        static constexpr uint32_t MAX_CHUNK_SIZE = 64 * 1024;
+        static constexpr size_t CHUNK_DOUBLINGS = 8;
+
+        vector<Chunk> chunks;
+        vector<int> freeChunks;
+        vector<unique_ptr<Slot[]>> slotBlocks;
+        PublishedDirectory<Slot*> slotDirectory;
+        PublishedDirectory<char*> chunkDirectory;
+        atomic<int> published;
+        int capacity;
+        int count;
+        int head;
+        int currentChunk;
+        long long firstOffset;
+        bool evictOldest;
+        size_t byteLimit;
+        size_t liveBytes;
+
+        const Slot& slotAt(int index) const
+        {
+            int position = head + index;
+            if (position >= capacity)
+                position -= capacity;
+            return slotDirectory[position >> SLOT_BLOCK_BITS][position & (SLOT_BLOCK_SIZE - 1)];
+        }
+
+        int slotBlockSize(int block) const;
+        void evictOldestMessage();
+        void releaseChunk(int chunk);
+        int takeChunk(size_t required);
+
+    public:
+        static const int MAX_MESSAGE_SIZE = 65535;
+
+        // Postconditions:
+        // - Creates an arena that can hold no messages and owns no memory.
+        MessageArena();
+
+        // Preconditions:
+        // - capacity must not be negative.
+        // Postconditions:
+        // - The arena can hold capacity messages; no memory is allocated until the first append.
+        explicit MessageArena(int capacity);
+
+        // Preconditions:
+        // - capacity must not be negative.
+        // Postconditions:
+        // - The arena holds at most capacity messages and, if byteLimit is non-zero, at most byteLimit message bytes.
+        // - With evictOldest set, appends beyond either limit evict the oldest messages instead of failing.
+        MessageArena(int capacity, bool evictOldest, size_t byteLimit);
+
+        // Postconditions:
+        // - The new arena holds the same messages, copied with one memcpy per chunk and per slot block.
+        MessageArena(const MessageArena& other);
+
+        // Postconditions:
+        // - Existing storage is replaced by a copy of other made with one memcpy per chunk and per slot block.
+        MessageArena& operator=(const MessageArena& other);
+
+        // Postconditions:
+        // - Storage is transferred from other, which is left as an empty arena with capacity 0.
+        MessageArena(MessageArena&& other) noexcept;
+        MessageArena& operator=(MessageArena&& other) noexcept;
+
+        // Preconditions:
+        // - message must be at most MAX_MESSAGE_SIZE bytes (and at most byteLimit bytes if one is set).
+        // - The arena must not be full unless it evicts.
+        // Postconditions:
+        // - The message bytes are copied to the end of the current chunk (or a new or recycled one) and a slot is recorded.
+        // - Previously stored messages are never moved; returns how many of the oldest messages were evicted to make room.
+        int append(string_view message);
+
+        // Preconditions:
+        // - index must be within [0, size()), counted from the oldest retained message.
+        // Postconditions:
+        // - Returns a view of the stored message without bounds checking.
+        string_view operator[](int index) const
+        {
+            const Slot& slot = slotAt(index);
+            return string_view(chunkDirectory[slot.chunk] + slot.offset, slot.length);
+        }
+
+        // Postconditions:
+        // - All messages are removed and offsets restart at 0; allocated chunks and slot blocks are kept for reuse.
+        void clear();
+
+        int size() const;
+
+        // Postconditions:
+        // - Returns how many messages are fully written, with acquire ordering; any thread may read messages below it
+        //   while the writer keeps appending.
+        int publishedSize() const
+        {
+            return published.load(memory_order_acquire);
+        }
+
+        int getCapacity() const;
+        long long getFirstOffset() const;
+        size_t bytesUsed() const;
+        size_t bytesReserved() const;
+};
+
+// Implementation invariant:
+// - Chunk sizes start at FIRST_CHUNK_SIZE and double up to MAX_CHUNK_SIZE (or the message size if larger),
+//   so small streams stay small while large streams amortise allocation over big chunks.
+// - Only chunks[currentChunk] receives new bytes (-1 when no chunk is in use); other live chunks are sealed.
+// - Chunks are filled in message order, so each chunk holds a contiguous run of messages and becomes free as soon as
+//   the last of them is evicted. Free chunks are listed in freeChunks and reused before any new chunk is allocated.
+// - Slots form a ring of capacity entries: message i (from the oldest) lives at position (head + i) mod capacity,
+//   and slot block k holds positions [k * SLOT_BLOCK_SIZE, (k + 1) * SLOT_BLOCK_SIZE), trimmed to capacity.
+//   A non-evicting arena never advances head, so its slots are laid out exactly in message order.
+// - liveBytes is the total length of the retained messages and is what byteLimit bounds.
+// - Readers reach slot blocks and chunk bytes only through slotDirectory and chunkDirectory, whose entries never move,
+//   never through the chunks or slotBlocks vectors, which the writer may reallocate.
+// - append writes the bytes and the slot first and then stores count into published with release ordering, so a
+//   reader that acquires published == n sees messages [0, n) completely written.
+// - Copies allocate chunks sized to the bytes in use so a copied stream carries no slack.
+
+#endif
@@ -0,0 +1,119 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#ifndef MESSAGERANGE_H
+#define MESSAGERANGE_H
+
+#include "MessageArena.h"
+#include <string>
+#include <string_view>
+#include <iterator>
+#include <cstddef>
+#include <stdexcept>
+
+using namespace std;
+
+class MessageRange
+{
+    // Class invariant:
+    // - MessageRange is a non-owning, read-only view of a contiguous run of messages inside a MsgStream.
+    // - It never allocates or copies message bytes; elements are exposed as string_view.
+    // - A range is valid only while its stream is alive and the stream's epoch still equals getEpoch().
+    //   Appending never changes the epoch; reset, assignment, or anything that replaces storage does.
+    // - Clients must not use a range (or views taken from it) after its epoch has expired.
+
+    public:
+        class iterator
+        {
+            public:
+                // Elements are string_views made on access, so -> hands out a proxy that holds one.
+                struct arrow
+                {
+                    string_view view;
+                    const string_view* operator->() const { return &view; }
+                };
+
+                using iterator_category = random_access_iterator_tag;
+                using value_type = string_view;
+                using difference_type = ptrdiff_t;
+                using pointer = arrow;
+                using reference = string_view;
+
+                iterator() : arena(nullptr), current(0) {}
+                iterator(const MessageArena* arena, int current) : arena(arena), current(current) {}
+
+                string_view operator*() const { return (*arena)[current]; }
+                arrow operator->() const { return arrow{ (*arena)[current] }; }
+                string_view operator[](difference_type offset) const { return (*arena)[current + offset]; }
+
+                iterator& operator++() { ++current; return *this; }
+                iterator operator++(int) { iterator previous = *this; ++current; return previous; }
+                iterator& operator--() { --current; return *this; }
+                iterator operator--(int) { iterator previous = *this; --current; return previous; }
+                iterator& operator+=(difference_type offset) { current += offset; return *this; }
+                iterator& operator-=(difference_type offset) { current -= offset; return *this; }
+                iterator operator+(difference_type offset) const { return iterator(arena, current + offset); }
+                iterator operator-(difference_type offset) const { return iterator(arena, current - offset); }
+                difference_type operator-(const iterator& other) const { return current - other.current; }
+                friend iterator operator+(difference_type offset, const iterator& it) { return it + offset; }
+
+                bool operator==(const iterator& other) const { return current == other.current; }
+                bool operator!=(const iterator& other) const { return current != other.current; }
+                bool operator<(const iterator& other) const { return current < other.current; }
+                bool operator>(const iterator& other) const { return current > other.current; }
+                bool operator<=(const iterator& other) const { return current <= other.current; }
+                bool operator>=(const iterator& other) const { return current >= other.current; }
+
+            private:
+                const MessageArena* arena;
+                int current;
+        };
+
+        // Postconditions:
+        // - Creates an empty range with epoch 0.
+        MessageRange() : arena(nullptr), first(0), count(0), epoch(0) {}
+
+        // Preconditions:
+        // - [first, first + count) must be stored in arena, which belongs to a stream whose current epoch is epoch.
+        // Postconditions:
+        // - The range views those messages without taking ownership.
+        MessageRange(const MessageArena* arena, int first, int count, unsigned long long epoch)
+            : arena(arena), first(first), count(count), epoch(epoch) {}
+
+        iterator begin() const { return iterator(arena, first); }
+        iterator end() const { return iterator(arena, first + count); }
+
+        // Preconditions:
+        // - index must be within [0, size()).
+        // Postconditions:
+        // - Returns a view of the message at index without bounds checking.
+        string_view operator[](int index) const { return (*arena)[first + index]; }
+
+        // Preconditions:
+        // - index must be within [0, size()); otherwise out_of_range is thrown.
+        string_view at(int index) const
+        {
+            if (index < 0 || index >= count)
+                throw out_of_range("Invalid index for message range.");
+            return (*arena)[first + index];
+        }
+
+        int size() const { return count; }
+        bool empty() const { return count == 0; }
+        unsigned long long getEpoch() const { return epoch; }
+
+    private:
+        const MessageArena* arena;
+        int first;
+        int count;
+        unsigned long long epoch;
+};
+
+// Implementation invariant:
+// - arena, first and count describe messages [first, first + count) of a stream's MessageArena; MessageRange only
+//   ever reads through them. Because arena chunks never relocate, string_views taken from the range remain valid
+//   while further messages are appended.
+// - epoch is copied from the stream when the range is created and never changes afterwards.
+// - All members are inline so a range scan compiles down to slot lookups with no allocation.
+
+#endif
@@ -2,145 +2,298 @@
 // 11/14/2024
 
 #include "MsgStream.h"
+#include "MessageArena.h"
+#include "StreamMetrics.h"
 #include <string>
 #include <memory>
+#include <algorithm>
+#include <climits>
 #include <stdexcept>
 
 using namespace std;
 
-MsgStream::MsgStream(int initialCapacity) : operationCount(0), messageCount(0)
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::BasicMsgStream(int initialCapacity) : BasicMsgStream(initialCapacity, CapacityMode::Fixed) {}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::BasicMsgStream(int initialCapacity, CapacityMode mode)
+    : BasicMsgStream(initialCapacity, mode, RetentionPolicy::rejectWhenFull()) {}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::BasicMsgStream(int initialCapacity, CapacityMode mode, const RetentionPolicy& retention)
+    : epoch(0), capacityMode(mode), retention(retention), messageCount(0)
 {
     capacity = calculateCapacity(initialCapacity);
-    maxOperations = calculateMaxOperations(initialCapacity);
-    messages = std::unique_ptr<std::string[]>(new std::string[capacity]);
+    budget = OperationBudget(defaultBudget(initialCapacity));
+    messages = MessageArena(capacity, retention.evictOldest, retention.maxBytes);
 }
 
-MsgStream::MsgStream() : capacity(0), maxOperations(0), operationCount(0), messages(nullptr), messageCount(0) {}
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::BasicMsgStream()
+    : capacity(0), budget(BudgetPolicy::lifetime(0)), epoch(0), capacityMode(CapacityMode::Fixed),
+      retention(RetentionPolicy::rejectWhenFull()), messages(), messageCount(0) {}
 
-MsgStream::MsgStream(const MsgStream& other)
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::~BasicMsgStream() {}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+unique_ptr<BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>> BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::clone() const
+{
+    return unique_ptr<BasicMsgStream>(new BasicMsgStream(*this));
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::BasicMsgStream(const BasicMsgStream& other)
+    : budget(other.budget), epoch(0), capacityMode(other.capacityMode), retention(other.retention), messages(other.messages),
+      metrics(other.metrics ? new StreamMetrics() : nullptr)
 {
     capacity = other.capacity;
-    maxOperations = other.maxOperations;
     messageCount = other.messageCount;
-    operationCount = other.operationCount;
-
-    messages = std::unique_ptr<std::string[]>(new std::string[capacity]);
-
-    for (int i = 0; i < messageCount; i++)
-    {
-        messages[i] = other.messages[i];
-    }
 }
 
-MsgStream& MsgStream::operator=(const MsgStream& other)
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>& BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::operator=(const BasicMsgStream& other)
 {
     if (this == &other) return *this;
 
-    std::unique_ptr<std::string[]> newMessages(new std::string[other.capacity]);
-
-    for (int i = 0; i < other.messageCount; i++)
-    {
-        newMessages[i] = other.messages[i];
-    }
+    MessageArena newMessages(other.messages);
 
     capacity = other.capacity;
-    maxOperations = other.maxOperations;
+    capacityMode = other.capacityMode;
+    retention = other.retention;
+    budget = other.budget;
     messageCount = other.messageCount;
-    operationCount = other.operationCount;
 
     messages = move(newMessages);
+    invalidateViews();
 
     return *this;
 }
 
-MsgStream::MsgStream(MsgStream&& other) noexcept
-    : capacity(0), maxOperations(0), operationCount(0), messages(nullptr), messageCount(0) {
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::BasicMsgStream(BasicMsgStream&& other) noexcept
+    : capacity(0), budget(BudgetPolicy::lifetime(0)), epoch(0), capacityMode(CapacityMode::Fixed),
+      retention(RetentionPolicy::rejectWhenFull()), messages(), messageCount(0) {
         swap(messages, other.messages);
         swap(capacity, other.capacity);
-        swap(maxOperations, other.maxOperations);
+        swap(capacityMode, other.capacityMode);
+        swap(retention, other.retention);
+        swap(budget, other.budget);
         swap(messageCount, other.messageCount);
-        swap(operationCount, other.operationCount);
+        swap(metrics, other.metrics);
+        other.invalidateViews();
 }
 
-MsgStream& MsgStream::operator=(MsgStream&& other) noexcept
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>& BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::operator=(BasicMsgStream&& other) noexcept
 {
     if (this == &other) return *this;
 
     messages = move(other.messages);
 
     capacity = other.capacity;
-    maxOperations = other.maxOperations;
+    capacityMode = other.capacityMode;
+    retention = other.retention;
+    budget = other.budget;
     messageCount = other.messageCount;
-    operationCount = other.operationCount;
+    metrics = move(other.metrics);
 
     other.capacity = 0;
     other.messageCount = 0;
-    other.operationCount = 0;
+    other.budget.reset();
+
+    invalidateViews();
+    other.invalidateViews();
 
     return *this;
 }
 
-unique_ptr<string[]> MsgStream::readMessages(int startRange, int endRange)
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+unique_ptr<string[]> BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::readMessages(long long startRange, long long endRange)
 {
+    long long started = metrics ? StreamMetrics::now() : 0;
+
     if (operationLimit())
-        throw runtime_error("Operation limit has been reached.");
+        throw rejected(RejectReason::OperationLimit, runtime_error("Operation limit has been reached."));
+
+    if (isEvictedRange(startRange, endRange))
+        throw rejected(RejectReason::Invalid, out_of_range("Requested messages have been evicted."));
 
     if (isInvalidRange(startRange, endRange))
-        throw out_of_range("Invalid range for reading messages.");
+        throw rejected(RejectReason::Invalid, out_of_range("Invalid range for reading messages."));
 
-    int range = endRange - startRange + 1;
-    std::unique_ptr<std::string[]> readMessages(new std::string[range]);
+    int first = static_cast<int>(startRange - messages.getFirstOffset());
+    int range = static_cast<int>(endRange - startRange) + 1;
+    // range is positive after the checks above; as an unsigned count the allocation size cannot overflow.
+    std::unique_ptr<std::string[]> readMessages(new std::string[static_cast<unsigned>(range)]);
 
     for (int i = 0; i < range; i++)
     {
-        readMessages[i] = messages[startRange + i];
+        if (first + i < messageCount)
+            readMessages[i] = string(messages[first + i]);
     }
 
-    operationCount++;
+    charge(1);
+    if (metrics)
+        metrics->recordRead(range, StreamMetrics::now() - started);
     return readMessages;
 }
 
-void MsgStream::appendMessage(const string& message)
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+MessageRange BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::viewMessages(long long startRange, long long endRange)
 {
+    long long started = metrics ? StreamMetrics::now() : 0;
+
     if (operationLimit())
-        throw runtime_error("Operation limit has been reached.");
+        throw rejected(RejectReason::OperationLimit, runtime_error("Operation limit has been reached."));
+
+    if (isEvictedRange(startRange, endRange))
+        throw rejected(RejectReason::Invalid, out_of_range("Requested messages have been evicted."));
+
+    if (isInvalidRange(startRange, endRange))
+        throw rejected(RejectReason::Invalid, out_of_range("Invalid range for reading messages."));
+
+    charge(1);
+    int first = static_cast<int>(startRange - messages.getFirstOffset());
+    if (metrics)
+        metrics->recordRead(endRange - startRange, StreamMetrics::now() - started);
+    return MessageRange(&messages, first, static_cast<int>(endRange - startRange), epoch);
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+MessageRange BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::viewCommitted(long long startRange, long long endRange) const
+{
+    if (retention.evictOldest)
+        throw runtime_error("Committed views are not available on evicting streams.");
+
+    long long committed = messages.publishedSize();
+    if (startRange < 0 || endRange <= startRange || endRange > committed)
+        throw out_of_range("Invalid range for reading messages.");
+
+    return MessageRange(&messages, static_cast<int>(startRange), static_cast<int>(endRange - startRange), epoch);
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+void BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::appendMessage(string_view message)
+{
+    long long started = metrics ? StreamMetrics::now() : 0;
+
+    if (operationLimit())
+        throw rejected(RejectReason::OperationLimit, runtime_error("Operation limit has been reached."));
+
+    if (isFull())
+        throw rejected(RejectReason::Full, runtime_error("Capacity has been reached."));
+
+    if (!isValidMessage(message))
+        throw rejected(RejectReason::Invalid, runtime_error("Invalid message."));
+
+    storeMessage(message);
+    charge(1);
+    if (metrics)
+        metrics->recordAppend(1, static_cast<long long>(message.size()), StreamMetrics::now() - started);
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+void BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::appendBatch(const string_view* batch, int count)
+{
+    long long started = metrics ? StreamMetrics::now() : 0;
+
+    if (count < 0)
+        throw rejected(RejectReason::Invalid, invalid_argument("Invalid batch size."));
+
+    if (count == 0)
+        return;
+
+    if (!canCharge(count))
+        throw rejected(RejectReason::OperationLimit, runtime_error("Operation limit has been reached."));
+
+    if (isFull() || (!retention.evictOldest && static_cast<long long>(messageCount) + count > capacity))
+        throw rejected(RejectReason::Full, runtime_error("Capacity has been reached."));
+
+    for (int i = 0; i < count; i++)
+    {
+        if (!isValidMessage(batch[i]))
+            throw rejected(RejectReason::Invalid, runtime_error("Invalid message."));
+    }
+
+    long long bytes = 0;
+    for (int i = 0; i < count; i++)
+    {
+        storeMessage(batch[i]);
+        bytes += static_cast<long long>(batch[i].size());
+    }
+    charge(count);
+    if (metrics)
+        metrics->recordAppend(count, bytes, StreamMetrics::now() - started);
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+void BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::appendBatch(const vector<string>& batch)
+{
+    vector<string_view> views(batch.begin(), batch.end());
+    appendBatch(views.data(), static_cast<int>(views.size()));
+}
 
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+void BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::ingestMessage(string_view message)
+{
     if (isFull())
         throw runtime_error("Capacity has been reached.");
 
     if (!isValidMessage(message))
         throw runtime_error("Invalid message.");
 
-    messages[messageCount] = message;
+    storeMessage(message);
+}
 
-    messageCount++;
-    operationCount++;
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+void BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::storeMessage(string_view message)
+{
+    if (messages.append(message) > 0)
+    {
+        // Evicting shifts every retained message down by one index, so outstanding views would silently move.
+        invalidateViews();
+    }
+    messageCount = messages.size();
 }
 
-int MsgStream::calculateMaxOperations(int capacity)
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+void BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::countOperation()
 {
-    return capacity * 2;
+    charge(1);
 }
 
-bool MsgStream::isFull() const
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+void BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::invalidateViews()
 {
-    return messageCount >= capacity;
+    epoch++;
 }
 
-bool MsgStream::operationLimit() const
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+int BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::calculateMaxOperations(int capacity)
 {
-    return operationCount >= maxOperations;
+    if (capacity > MAX_GROWABLE_CAPACITY)
+    {
+        capacity = MAX_GROWABLE_CAPACITY;
+    }
+    return static_cast<int>(min<long long>(static_cast<long long>(capacity) * LimitPolicy::OPERATION_MULTIPLIER, INT_MAX));
 }
 
-bool MsgStream::isValidMessage(const string& message) const
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+BudgetPolicy BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::defaultBudget(int capacity)
 {
-    return message != "" && message.length() <= MAX_STRING_LENGTH;
+    if (!LimitPolicy::ENFORCED || retention.evictOldest)
+        return BudgetPolicy::unlimited();
+
+    return BudgetPolicy::lifetime(max(0, calculateMaxOperations(capacity)));
 }
 
-int MsgStream::calculateCapacity(int capacity)
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+int BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::calculateCapacity(int capacity)
 {
-    if (capacity > MAX_CAPACITY) {
-        capacity = MAX_CAPACITY;
+    int maximum = capacityMode == CapacityMode::Growable ? MAX_GROWABLE_CAPACITY : MAX_CAPACITY;
+    if (capacity > maximum) {
+        capacity = maximum;
     }
     if (capacity <= 0) {
         capacity = 1;
@@ -148,26 +301,41 @@ int MsgStream::calculateCapacity(int capacity)
     return capacity;
 }
 
-bool MsgStream::isInvalidRange(int startRange, int endRange) const
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+bool BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::isEvictedRange(long long startRange, long long endRange) const
 {
-    return (startRange < 0 || endRange <= startRange || endRange > messageCount || startRange >= messageCount);
+    return startRange >= 0 && endRange > startRange && startRange < messages.getFirstOffset();
 }
 
-void MsgStream::reset()
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+bool BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::isInvalidRange(long long startRange, long long endRange) const
+{
+    long long nextOffset = getNextOffset();
+    return (startRange < messages.getFirstOffset() || endRange <= startRange || endRange > nextOffset || startRange >= nextOffset);
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+void BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::reset()
 {
     messageCount = 0;
-    operationCount = 0;
+    budget.reset();
 
-    messages = make_unique<string[]>(capacity);
+    messages.clear();
+    invalidateViews();
 }
 
-bool MsgStream::operator!() const {
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+bool BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::operator!() const {
     return messageCount == 0;
 }
 
-MsgStream MsgStream::operator+(const MsgStream& other) const {
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy> BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::operator+(const BasicMsgStream& other) const {
     
-    MsgStream merged(capacity + other.capacity);
+    CapacityMode mode = capacityMode == CapacityMode::Growable || other.capacityMode == CapacityMode::Growable
+        ? CapacityMode::Growable : CapacityMode::Fixed;
+    long long combined = static_cast<long long>(capacity) + other.capacity;
+    BasicMsgStream merged(static_cast<int>(min<long long>(combined, MAX_GROWABLE_CAPACITY)), mode, retention);
     for (int i = 0; i < messageCount; i++)
     {
         merged.appendMessage(messages[i]);
@@ -178,7 +346,8 @@ MsgStream MsgStream::operator+(const MsgStream& other) const {
     return merged;
 }
 
-bool MsgStream::operator==(const MsgStream& other) const {
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+bool BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::operator==(const BasicMsgStream& other) const {
     
     if (messageCount != other.messageCount || capacity != other.capacity)
     {
@@ -194,13 +363,15 @@ bool MsgStream::operator==(const MsgStream& other) const {
     return true;
 }
 
-bool MsgStream::operator!=(const MsgStream& other) const {
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+bool BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::operator!=(const BasicMsgStream& other) const {
     return !(*this == other);
 }
 
-MsgStream& MsgStream::operator+=(const MsgStream& other) {
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>& BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::operator+=(const BasicMsgStream& other) {
     
-    if (messageCount + other.messageCount > capacity)
+    if (!retention.evictOldest && messageCount + other.messageCount > capacity)
     {
         throw std::runtime_error("Combined MsgStream exceeds capacity");
     }
@@ -213,16 +384,104 @@ MsgStream& MsgStream::operator+=(const MsgStream& other) {
     return *this;
 }
 
-int MsgStream::getMessageCount() const
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+int BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::getMessageCount() const
 {
     return messageCount;
 }
 
-int MsgStream::getMaxOperations() const{
-    return maxOperations;
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+int BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::getMaxOperations() const{
+    BudgetPolicy policy = budget.getPolicy();
+    if (policy.kind == BudgetKind::Unlimited)
+        return INT_MAX;
+
+    return static_cast<int>(min<long long>(policy.limit, INT_MAX));
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+void BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::setOperationBudget(const BudgetPolicy& policy)
+{
+    if (!LimitPolicy::ENFORCED && policy.kind != BudgetKind::Unlimited)
+        throw invalid_argument("Operation budgets are not enforced by this stream.");
+
+    budget = OperationBudget(policy);
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+BudgetPolicy BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::getOperationBudget() const
+{
+    return budget.getPolicy();
 }
 
-int MsgStream::getCapacity() const
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+int BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::getCapacity() const
 {
     return capacity;
-}
\ No newline at end of file
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+size_t BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::getStorageBytes() const
+{
+    return sizeof(BasicMsgStream) + messages.bytesReserved();
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+CapacityMode BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::getCapacityMode() const
+{
+    return capacityMode;
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+RetentionPolicy BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::getRetentionPolicy() const
+{
+    return retention;
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+long long BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::getFirstOffset() const
+{
+    return messages.getFirstOffset();
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+long long BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::getNextOffset() const
+{
+    return messages.getFirstOffset() + messageCount;
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+long long BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::getCommittedCount() const
+{
+    return messages.publishedSize();
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+void BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::enableMetrics()
+{
+    if (!metrics)
+    {
+        metrics = unique_ptr<StreamMetrics>(new StreamMetrics());
+    }
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+bool BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::hasMetrics() const
+{
+    return metrics != nullptr;
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+StreamMetricsSnapshot BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::getMetrics() const
+{
+    return metrics ? metrics->snapshot() : StreamMetricsSnapshot::empty();
+}
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+unsigned long long BasicMsgStream<StoragePolicy, ValidationPolicy, LimitPolicy>::getEpoch() const
+{
+    return epoch;
+}
+
+template class BasicMsgStream<StandardStorage, LengthValidation, LifetimeLimit>;
+template class BasicMsgStream<StandardStorage, TrustedMessages, NoOperationLimit>;
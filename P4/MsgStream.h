@@ -4,51 +4,160 @@
 #ifndef MSGSTREAM_H
 #define MSGSTREAM_H
 
+#include "MessageRange.h"
+#include "MessageArena.h"
+#include "RetentionPolicy.h"
+#include "OperationBudget.h"
+#include "StreamMetrics.h"
+#include "StreamPolicies.h"
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <stdexcept>
 
 using namespace std;
 
-class MsgStream
+// Fixed streams clamp capacity to MAX_CAPACITY; Growable streams accept up to MAX_GROWABLE_CAPACITY messages and
+// allocate storage only as messages arrive, so capacity acts as a soft limit rather than a preallocated array size.
+enum class CapacityMode
+{
+    Fixed,
+    Growable
+};
+
+template <typename StoragePolicy, typename ValidationPolicy, typename LimitPolicy>
+class BasicMsgStream
 {
     // Class invariant:
+    // - BasicMsgStream is a message stream whose limits and checks are fixed at compile time by its StoragePolicy,
+    //   ValidationPolicy and LimitPolicy (see StreamPolicies.h); MsgStream is the instantiation used throughout.
     // - The "messages" array may only contain valid, non-null, and non-empty strings, each adhering to the maximum length defined by MAX_STRING_LENGTH.
-    // - The total number of operations performed on the MsgStream instance must not exceed the limit established by MAX_OPERATIONS, which is set as a multiple of the object's capacity.
-    // - The number of messages appended to the array cannot exceed the fixed capacity of the message stream, which must be between 1 and MAX_CAPACITY, as determined at initialization.
+    //   The ValidationPolicy decides whether the stream checks this or the caller guarantees it.
+    // - Client operations are admitted by an OperationBudget. By default it is a lifetime limit of OPERATION_MULTIPLIER
+    //   times the requested capacity (unlimited for evicting streams); setOperationBudget swaps in an unlimited budget
+    //   or a token bucket. A LimitPolicy that is not ENFORCED has no budget to check or charge.
+    // - The number of messages appended to the array cannot exceed the fixed capacity of the message stream, which must be between 1 and MAX_CAPACITY
+    //   (or MAX_GROWABLE_CAPACITY for a Growable stream), as determined at initialization.
     // - Once established, the capacity remains unchanged throughout the lifetime of the object unless reset by the client.
     // - Clients must be prepared to handle exceptions, particularly those related to invalid message length and capacity limits, to ensure robust error handling.
+    // - Views returned by viewMessages stay valid only while the stream's epoch is unchanged; any operation that replaces,
+    //   clears or evicts stored messages starts a new epoch.
+    // - Messages are addressed by logical offset. Offsets start at 0 and only grow until reset; with an evicting
+    //   RetentionPolicy the stream keeps the latest messages in [getFirstOffset(), getNextOffset()) and is never full.
+    // - Single-producer/multi-consumer use: while one thread appends, any number of threads may call getCommittedCount
+    //   and viewCommitted (and read the views they return) without locks. Every other member belongs to the writer,
+    //   except getMetrics, which any thread may call once metrics are enabled.
 
     private:
         int capacity;
-        int maxOperations;
-        int operationCount;
+        OperationBudget budget;
+        unsigned long long epoch;
+        CapacityMode capacityMode;
+        RetentionPolicy retention;
 
         int calculateMaxOperations(int capacity);
+        BudgetPolicy defaultBudget(int capacity);
         int calculateCapacity(int capacity);
-        bool isInvalidRange(int startRange, int endRange) const;
+        bool isEvictedRange(long long startRange, long long endRange) const;
+        bool isInvalidRange(long long startRange, long long endRange) const;
+        void storeMessage(string_view message);
+
+        bool canCharge(int count) const
+        {
+            return !LimitPolicy::ENFORCED || budget.canCharge(count);
+        }
+
+        void charge(int count)
+        {
+            if (LimitPolicy::ENFORCED)
+                budget.charge(count);
+        }
 
     protected:
-        static const int MAX_CAPACITY = 200;
-        const int MAX_STRING_LENGTH = 150;
+        static const int MAX_CAPACITY = StoragePolicy::MAX_CAPACITY;
+        static const int MAX_GROWABLE_CAPACITY = StoragePolicy::MAX_GROWABLE_CAPACITY;
+        static const int MAX_STRING_LENGTH = ValidationPolicy::MAX_STRING_LENGTH;
 
-        unique_ptr<string[]> messages;
+        MessageArena messages;
         int messageCount;
+        unique_ptr<StreamMetrics> metrics;
+
+        bool isFull() const
+        {
+            return !retention.evictOldest && messageCount >= capacity;
+        }
+
+        bool operationLimit() const
+        {
+            return !canCharge(1);
+        }
+
+        bool isValidMessage(string_view message) const
+        {
+            return ValidationPolicy::isValid(message);
+        }
+
+        // Preconditions:
+        // - Message stream must not be full and the message must be valid.
+        // Postconditions:
+        // - Message is appended to the stream without counting against the operation limit, so that
+        //   subclasses can restore persisted state without consuming the client's operation budget.
+        void ingestMessage(string_view message);
+
+        // Postconditions:
+        // - One operation is charged to the budget for an operation a subclass serves without calling into MsgStream.
+        void countOperation();
+
+        // Postconditions:
+        // - The epoch is advanced so that outstanding MessageRange views are known to be expired.
+        void invalidateViews();
 
-        bool virtual isFull() const;
-        bool virtual operationLimit() const;
-        bool virtual isValidMessage(const string& message) const;
+        // Postconditions:
+        // - The refused operation is counted under reason if metrics are enabled, and error is returned for the
+        //   caller to throw.
+        template <typename Error>
+        Error rejected(RejectReason reason, const Error& error) const
+        {
+            if (metrics)
+                metrics->recordRejection(reason);
+            return error;
+        }
         
     public:
         // Preconditions:
         // - Capacity must be between 1 and MAX_CAPACITY.
         // Postconditions:
         // - Capacity is initialized and the "messages" array is created.
-        MsgStream(int capacity);
+        BasicMsgStream(int capacity);
+
+        // Preconditions:
+        // - Capacity must be between 1 and MAX_CAPACITY for Fixed mode, or MAX_GROWABLE_CAPACITY for Growable mode.
+        // Postconditions:
+        // - Capacity and mode are initialized; message storage grows in chunks as messages are appended and
+        //   never relocates messages already stored.
+        BasicMsgStream(int capacity, CapacityMode mode);
+
+        // Preconditions:
+        // - Capacity as above; retention.maxBytes, if set, must be at least as large as any message appended.
+        // Postconditions:
+        // - As above, with retention deciding whether a full stream rejects appends or evicts its oldest messages.
+        //   An evicting stream is a bounded-memory tail buffer and starts with an unlimited operation budget.
+        BasicMsgStream(int capacity, CapacityMode mode, const RetentionPolicy& retention);
 
         // Postcondition:
         // - MsgStream object created with all variables set to 0 and nullptr.
-        MsgStream();
+        BasicMsgStream();
+
+        // Postconditions:
+        // - Releases message storage; derived streams release their own resources, so a stream may be owned and
+        //   destroyed through a MsgStream pointer.
+        virtual ~BasicMsgStream();
+
+        // Postconditions:
+        // - Returns an independent deep copy of the most derived stream, so containers holding streams by pointer can
+        //   copy them without slicing.
+        unique_ptr<BasicMsgStream> virtual clone() const;
         
         // Preconditions:
         // - passed in object must be valid and initialized.
@@ -56,7 +165,7 @@ class MsgStream
         // Postconditions:
         // - Deep copying of the passed in object is created with all resources copied.
         // - New object is independent of other object.
-        MsgStream(const MsgStream& other);
+        BasicMsgStream(const BasicMsgStream& other);
 
         // Preconditions:
         // - passed in object must be valid and initialized.
@@ -65,14 +174,14 @@ class MsgStream
         // - Current MsgStream object is updated to be a deep copy of passed in object.
         // - Existing resources in current object are replaced.
         // - Current MsgStream is independent of the passed in object with no shared resources.
-        MsgStream& operator=(const MsgStream& other);
+        BasicMsgStream& operator=(const BasicMsgStream& other);
 
         // Preconditions:
         // - passed in object must be valid and initialized.
         // Postconditions:
         // - current MsgStream object takes ownership of resources from passed in object.
         // - passed in object is left in a valid empty state, with resources safely transferred.
-        MsgStream(MsgStream&& other) noexcept;
+        BasicMsgStream(BasicMsgStream&& other) noexcept;
 
         // Preconditions:
         // - passed in object must be valid and initialized.
@@ -80,28 +189,80 @@ class MsgStream
         // Postconditions:
         // - Current MsgStream object takes ownership of all resources.
         // - passed in object is left in a valid empty state.
-        MsgStream& operator=(MsgStream&& other) noexcept;
+        BasicMsgStream& operator=(BasicMsgStream&& other) noexcept;
 
         // Preconditions:
-        // - Operation count must not exceed MAX_OPERATIONS.
-        // - The start and end ranges must be acceptable within the bounds of the message array.
+        // - The operation budget must admit the operation.
+        // - The start and end ranges are logical offsets and must lie within [getFirstOffset(), getNextOffset()).
         // Postconditions:
         // - Returns the messages between the specified start and end range.
-        unique_ptr<string[]> virtual readMessages(int startRange, int endRange);
+        // - Throws out_of_range "Requested messages have been evicted." if startRange is older than getFirstOffset().
+        unique_ptr<string[]> virtual readMessages(long long startRange, long long endRange);
+
+        // Preconditions:
+        // - The operation budget must admit the operation.
+        // - The range [startRange, endRange) must lie within [getFirstOffset(), getNextOffset()).
+        // Postconditions:
+        // - Returns a non-owning view of the messages in [startRange, endRange) without allocating or copying.
+        // - The view is tied to the current epoch and expires when the stream is reset, assigned, destroyed,
+        //   or evicts a message.
+        // - Throws out_of_range "Requested messages have been evicted." if startRange is older than getFirstOffset().
+        MessageRange virtual viewMessages(long long startRange, long long endRange);
+
+        // Preconditions:
+        // - The stream must not evict (RetentionPolicy::rejectWhenFull), and [startRange, endRange) must lie within
+        //   [0, getCommittedCount()) as seen by the calling thread.
+        // Postconditions:
+        // - Returns a view of fully written messages that is safe to read while another thread keeps appending.
+        // - Does not count against the operation limit and takes no lock; throws out_of_range for an invalid range.
+        MessageRange viewCommitted(long long startRange, long long endRange) const;
 
         // Preconditions:
         // - Message stream must not be full.
-        // - Operation count must not exceed MAX_OPERATIONS.
+        // - The operation budget must admit the operation.
         // - The message must be non-null, non-empty, and within the MAX_STRING_LENGTH.
         // Postconditions:
         // - Message is appended to the stream; the message and operation counts are updated.
-        void virtual appendMessage(const string& message);
+        // - With an evicting retention policy, the oldest messages are evicted first if the stream is at its limits.
+        // - The bytes are copied straight into the arena, so strings, literals and views are all stored without
+        //   allocating a temporary string.
+        void virtual appendMessage(string_view message);
+
+        // Preconditions:
+        // - length must be between 1 and MAX_STRING_LENGTH; write must fill exactly length bytes at the pointer it is given.
+        // - The other conditions are as for appendMessage.
+        // Postconditions:
+        // - The message is built by write in a stack buffer and appended through appendMessage, so producers that format
+        //   messages need no heap string and derived streams still see every append.
+        // - If write throws, nothing is appended.
+        template <typename Writer>
+        void emplaceMessage(size_t length, Writer write)
+        {
+            if (length == 0 || length > static_cast<size_t>(MAX_STRING_LENGTH))
+                throw rejected(RejectReason::Invalid, runtime_error("Invalid message."));
+
+            char buffer[MAX_STRING_LENGTH];
+            write(buffer);
+            appendMessage(string_view(buffer, length));
+        }
+
+        // Preconditions:
+        // - batch must point to count messages (count >= 0), each meeting the appendMessage validity criteria.
+        // - The stream must have room for all count messages and the operation budget must cover count operations.
+        // Postconditions:
+        // - All messages are appended in order and count operations are charged, or, if any check fails, none are
+        //   appended and the stream is unchanged. An evicting stream evicts as needed, as for appendMessage.
+        void virtual appendBatch(const string_view* batch, int count);
+
+        // Postconditions:
+        // - Same as above for every message in batch.
+        void appendBatch(const vector<string>& batch);
 
         // Preconditions:
         // - MsgStream object must be valid and initialized.
         // Postconditions:
         // - All messages in MsgStream are cleared and replaced with an empty array.
-        // - message count and operation count are reset to 0.
+        // - message count is reset to 0 and the full operation budget is available again.
         void virtual reset();
         
         // Preconditions:
@@ -116,20 +277,20 @@ class MsgStream
         // Postconditions:
         // - Returns a new MsgStream object containing all messages from both MsgStreams.
         // - The original MsgStream objects remain unchanged.
-        MsgStream operator+(const MsgStream& other) const;
+        BasicMsgStream operator+(const BasicMsgStream& other) const;
 
         // Preconditions:
         // - Both MsgStream objects are valid and initialized.
         // - The capacity and message counts of both MsgStreams are accurately set.
         // Postconditions:
         // - Returns true if the two MsgStreams are identical in capacity, message count, and content; otherwise false.
-        bool operator==(const MsgStream& other) const;
+        bool operator==(const BasicMsgStream& other) const;
 
         // Preconditions:
         // - Both MsgStream objects are valid and initialized.
         // Postconditions:
         // - Returns true if the two MsgStreams are not equal; otherwise false.
-        bool operator!=(const MsgStream& other) const;
+        bool operator!=(const BasicMsgStream& other) const;
 
         // Preconditions:
         // - Both MsgStream objects are valid and initialized.
@@ -137,23 +298,96 @@ class MsgStream
         // Postconditions:
         // - Appends all messages from the other MsgStream to the current MsgStream.
         // - Throws a runtime error if the combined message count exceeds the capacity.
-        MsgStream& operator+=(const MsgStream& other);
+        BasicMsgStream& operator+=(const BasicMsgStream& other);
 
         int getMessageCount() const;
+
+        // Postconditions:
+        // - Returns the lifetime limit or token bucket size of the operation budget, or INT_MAX if it is unlimited.
         int getMaxOperations() const;
+
+        // Postconditions:
+        // - policy replaces the operation budget, with its full allowance available, from the next operation.
+        // - Throws invalid_argument if policy is not unlimited and the LimitPolicy is not ENFORCED.
+        void setOperationBudget(const BudgetPolicy& policy);
+        BudgetPolicy getOperationBudget() const;
         int getCapacity() const;
+        CapacityMode getCapacityMode() const;
+        RetentionPolicy getRetentionPolicy() const;
+        unsigned long long getEpoch() const;
+
+        // Postconditions:
+        // - Returns the logical offset of the oldest retained message, i.e. the number of messages evicted since reset.
+        long long getFirstOffset() const;
+
+        // Postconditions:
+        // - Returns the logical offset the next appended message will receive.
+        long long getNextOffset() const;
+
+        // Postconditions:
+        // - Returns the number of messages fully written by the writer, read with acquire ordering so any thread may
+        //   then view them; safe to call while another thread appends.
+        long long getCommittedCount() const;
+
+        // Postconditions:
+        // - Returns the bytes held by this object and its message storage, including reserved but unused space.
+        size_t getStorageBytes() const;
+
+        // Postconditions:
+        // - From now on the stream counts its appends, reads and refused operations (and a DurableStream its flushes
+        //   and syncs), and times each call into a latency histogram. Calling it again keeps the counts so far.
+        void enableMetrics();
+        bool hasMetrics() const;
+
+        // Postconditions:
+        // - Returns a snapshot of the stream's metrics, or an empty one if they are not enabled.
+        StreamMetricsSnapshot getMetrics() const;
 };
 
 // Implementation invariant:
+// - The policies are read only through their constants and static functions, and isFull, operationLimit and
+//   isValidMessage are inline and non-virtual (no derived stream overrides them), so each check folds into the
+//   operation calling it, and one a policy disables (NoOperationLimit, TrustedMessages) is removed by the compiler.
+// - Members are defined in MsgStream.cpp and instantiated there for the policy sets declared below; a new set of
+//   policies is added with an alias and an explicit instantiation beside them, which keeps every stream's code in
+//   one translation unit instead of in each file that uses it.
 // - The message stream must always maintain its message count and operation count within the defined limits.
-// - The "messages" array should always contain valid messages that meet the set constraints.
-// - Messages are stored sequentially in the messages array without any gaps or uninitialized entries within the valid range.
+// - The "messages" arena should always contain valid messages that meet the set constraints.
+// - Messages are packed back-to-back in the MessageArena's chunks with a slot per message, without any gaps within the
+//   valid range, so appends are a memcpy plus a bump and copies are a memcpy per chunk and slot block.
+// - messageCount always equals messages.size(), the number of retained messages; logical offset o is arena index
+//   o - messages.getFirstOffset(), so a non-evicting stream's offsets are plain indices.
 // - The capacity must not be exceeded; attempting to append beyond capacity should throw an appropriate error.
-// - The operation count must accurately reflect the total number of client operations performed on the stream.
+// - Every successful client operation is charged to budget exactly once, after it succeeds; failed operations are
+//   checked with canCharge but never charged. Checking an unlimited or lifetime budget is a single comparison, and
+//   with a LimitPolicy that is not ENFORCED the budget stays unlimited and is never checked or charged.
+// - Views of committed messages stay valid until the epoch changes; reset, copy/move assignment and moving out of a stream
+//   advance the epoch, and so does an append that evicts. Appends that evict nothing never do, because arena chunks
+//   are never relocated.
+// - Capacity only bounds the message count; memory is proportional to the messages actually stored, which is what
+//   lets Growable streams hold millions of messages.
+// - appendMessage makes a message visible to readers only through the arena's release-store of its published count;
+//   viewCommitted bounds itself by an acquire-load of that count, so readers never see a half-written message.
+// - appendBatch validates every message and checks the limits against the whole batch before storing any of them, so
+//   a batch is all-or-nothing and its per-message cost is the arena append alone.
+// - metrics is null until enableMetrics, so an uninstrumented operation pays one pointer test for timing and one for
+//   recording. Operations are timed from entry to success; a refused operation is counted by reason but not timed.
+//   A copy of an instrumented stream gets its own empty metrics, copy assignment keeps the target's, and moves
+//   transfer them with the rest of the stream.
 // - overloaded operator! provides a quick way to check if the stream is empty, improving readability.
 // - overloaded operator+ allows merging two stream into a new stream for clear abstraction.
 // - overloaded operator== enables comparison of two streams to enhance usability for equality checks.
 // - overloaded operator!= enables comparison of two stream but returns the negation of ==.
 // - overloaded operator+= helps in combining messages of two objects into one.
 
+// The stream used throughout: messages of 1 to 150 characters, Fixed streams of up to 200 of them, and a lifetime
+// budget of twice the capacity.
+using MsgStream = BasicMsgStream<StandardStorage, LengthValidation, LifetimeLimit>;
+
+// A stream for producers that validate messages and admit operations themselves: appends are the storage work alone.
+using TrustedMsgStream = BasicMsgStream<StandardStorage, TrustedMessages, NoOperationLimit>;
+
+extern template class BasicMsgStream<StandardStorage, LengthValidation, LifetimeLimit>;
+extern template class BasicMsgStream<StandardStorage, TrustedMessages, NoOperationLimit>;
+
 #endif
\ No newline at end of file
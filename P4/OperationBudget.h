@@ -0,0 +1,154 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#ifndef OPERATIONBUDGET_H
+#define OPERATIONBUDGET_H
+
+#include <chrono>
+#include <climits>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+// Unlimited never refuses an operation, Lifetime allows a fixed number of operations until reset (the original
+// 2 * capacity cap), and TokenBucket allows a sustained rate with bursts up to the bucket size.
+enum class BudgetKind
+{
+    Unlimited,
+    Lifetime,
+    TokenBucket
+};
+
+struct BudgetPolicy
+{
+    // Class invariant:
+    // - BudgetPolicy decides how many client operations a stream may serve.
+    // - limit is the lifetime operation count for Lifetime and the bucket size (largest burst) for TokenBucket.
+    // - operationsPerSecond is the TokenBucket refill rate and is 0 for the other kinds.
+
+    BudgetKind kind;
+    long long limit;
+    long long operationsPerSecond;
+
+    // Postconditions:
+    // - Returns a policy that never refuses an operation.
+    static BudgetPolicy unlimited()
+    {
+        return BudgetPolicy{ BudgetKind::Unlimited, 0, 0 };
+    }
+
+    // Preconditions:
+    // - operations must not be negative.
+    // Postconditions:
+    // - Returns a policy that allows operations operations until the stream is reset.
+    static BudgetPolicy lifetime(long long operations)
+    {
+        if (operations < 0)
+            throw invalid_argument("Operation limit must not be negative.");
+        return BudgetPolicy{ BudgetKind::Lifetime, operations, 0 };
+    }
+
+    // Preconditions:
+    // - operationsPerSecond and burst must be greater than 0.
+    // Postconditions:
+    // - Returns a policy that allows operationsPerSecond operations per second on average and up to burst at once.
+    static BudgetPolicy tokenBucket(long long operationsPerSecond, long long burst)
+    {
+        if (operationsPerSecond <= 0 || burst <= 0)
+            throw invalid_argument("Token bucket rate and burst must be positive.");
+        return BudgetPolicy{ BudgetKind::TokenBucket, burst, operationsPerSecond };
+    }
+};
+
+class OperationBudget
+{
+    // Class invariant:
+    // - OperationBudget applies a BudgetPolicy to one stream; it is not thread-safe and belongs to the stream's writer.
+    // - canCharge(count) reports whether count operations may run now and charge(count) spends them; callers check
+    //   before doing the work and charge after it succeeds, so failed operations are never counted.
+
+    public:
+        // Postconditions:
+        // - Creates an unlimited budget.
+        OperationBudget() : OperationBudget(BudgetPolicy::unlimited()) {}
+
+        // Postconditions:
+        // - Creates a budget with the full allowance of policy available.
+        explicit OperationBudget(const BudgetPolicy& policy) : policy(policy)
+        {
+            reset();
+        }
+
+        // Postconditions:
+        // - Returns true if count operations fit in the budget; a token bucket is refilled first if needed.
+        bool canCharge(long long count) const
+        {
+            return remaining >= count || refill(count);
+        }
+
+        // Preconditions:
+        // - canCharge(count) returned true and nothing was charged since.
+        void charge(long long count)
+        {
+            remaining -= count;
+        }
+
+        // Postconditions:
+        // - Returns count previously charged operations to the budget, never above the policy's allowance.
+        void refund(long long count)
+        {
+            remaining = policy.kind == BudgetKind::Unlimited ? LLONG_MAX : min(remaining + count, policy.limit);
+        }
+
+        // Postconditions:
+        // - The full allowance is available again and a token bucket starts full.
+        void reset()
+        {
+            remaining = policy.kind == BudgetKind::Unlimited ? LLONG_MAX : policy.limit;
+            lastRefill = chrono::steady_clock::now();
+        }
+
+        BudgetPolicy getPolicy() const { return policy; }
+
+    private:
+        BudgetPolicy policy;
+        mutable long long remaining;
+        mutable chrono::steady_clock::time_point lastRefill;
+
+        bool refill(long long count) const
+        {
+            if (policy.kind != BudgetKind::TokenBucket)
+                return false;
+
+            auto now = chrono::steady_clock::now();
+            double seconds = chrono::duration<double>(now - lastRefill).count();
+            long long earned = static_cast<long long>(seconds * policy.operationsPerSecond);
+            if (earned > 0)
+            {
+                if (remaining + earned >= policy.limit)
+                {
+                    remaining = policy.limit;
+                    lastRefill = now;
+                }
+                else
+                {
+                    // Only the time that produced whole tokens is consumed, so fractional progress carries over.
+                    remaining += earned;
+                    lastRefill += chrono::duration_cast<chrono::steady_clock::duration>(
+                        chrono::duration<double>(static_cast<double>(earned) / policy.operationsPerSecond));
+                }
+            }
+            return remaining >= count;
+        }
+};
+
+// Implementation invariant:
+// - remaining is the number of operations that may run right now. Every kind keeps its fast path to the single
+//   comparison in canCharge: Unlimited starts at LLONG_MAX (never reached by counting down), Lifetime counts down
+//   from limit, and only a TokenBucket that has run dry pays for reading the clock.
+// - remaining and lastRefill are mutable because refilling a token bucket is lazy bookkeeping; it does not change
+//   what the budget allows.
+// - Policies are plain values so each stream, and each partition of a PartitionStream, can be given its own.
+
+#endif
@@ -4,13 +4,32 @@
 #include "PartitionStream.h"
 #include "MsgStream.h"
 #include "DurableStream.h"
+#include "InMemoryStream.h"
+#include "SegmentedLog.h"
+#include "IoRing.h"
 
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 #include <fstream>
 #include <stdexcept>
+#include <cstring>
+#include <climits>
+#include <chrono>
+#include <filesystem>
 #include <iostream>
 
+#include <csignal>
+#include <sys/resource.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
 using namespace std;
 
 void testPartitionStreamAllMsgStreams();
@@ -18,6 +37,42 @@ void testPartitionStreamAllDurableStreams();
 void testPartitionStreamMixedStreams();
 void testPartitionStreamSingleStream();
 void testPartitionStreamEdgeCases();
+void testDurableStreamMappedReads();
+void testMsgStreamRetention();
+void testPartitionStreamKeys();
+void testPartitionStreamConcurrentWrites();
+void testMsgStreamConcurrentReaders();
+void testPartitionStreamDurablePartitions();
+void testBatchAppend();
+void testEmplaceMessage();
+void testOperationBudgets();
+void testDurableStreamRecovery();
+void testDurableStreamReset();
+void testBackgroundFlush();
+void testSharedPartitionFlush();
+void testStreamMetrics();
+void testStreamPolicies();
+void testInMemoryPartitions();
+void testDurableStreamClone();
+void testFailedRingFlush();
+void testLegacyImport();
+void testReadsKeepBatching();
+
+// Checks print their result as before; any that does not hold is counted so the driver exits non-zero and ctest fails.
+int failedChecks = 0;
+
+bool check(bool passed) {
+    if (!passed) {
+        failedChecks++;
+    }
+    return passed;
+}
+
+template <typename T>
+T expect(const T& value, const T& expected) {
+    check(value == expected);
+    return value;
+}
 
 int main ()
 {
@@ -37,10 +92,75 @@ int main ()
         cout << "\n=== Testing Some Additional Edge Cases ===" << endl;
         testPartitionStreamEdgeCases();
 
+        cout << "\n=== Testing DurableStream memory-mapped reads ===" << endl;
+        testDurableStreamMappedReads();
+
+        cout << "\n=== Testing MsgStream ring-buffer retention ===" << endl;
+        testMsgStreamRetention();
+
+        cout << "\n=== Testing PartitionStream reassigned and string keys ===" << endl;
+        testPartitionStreamKeys();
+
+        cout << "\n=== Testing PartitionStream concurrent writes ===" << endl;
+        testPartitionStreamConcurrentWrites();
+
+        cout << "\n=== Testing MsgStream single writer with concurrent readers ===" << endl;
+        testMsgStreamConcurrentReaders();
+
+        cout << "\n=== Testing PartitionStream with durable partitions held by pointer ===" << endl;
+        testPartitionStreamDurablePartitions();
+
+        cout << "\n=== Testing batch appends ===" << endl;
+        testBatchAppend();
+
+        cout << "\n=== Testing views and emplaced messages ===" << endl;
+        testEmplaceMessage();
+
+        cout << "\n=== Testing operation budgets ===" << endl;
+        testOperationBudgets();
+
+        cout << "\n=== Testing DurableStream crash recovery ===" << endl;
+        testDurableStreamRecovery();
+
+        cout << "\n=== Testing DurableStream reset by truncation ===" << endl;
+        testDurableStreamReset();
+
+        cout << "\n=== Testing DurableStream background flushing ===" << endl;
+        testBackgroundFlush();
+
+        cout << "\n=== Testing PartitionStream shared flush of durable partitions ===" << endl;
+        testSharedPartitionFlush();
+
+        cout << "\n=== Testing stream metrics ===" << endl;
+        testStreamMetrics();
+
+        cout << "\n=== Testing stream policies ===" << endl;
+        testStreamPolicies();
+
+        cout << "\n=== Testing in-memory partitions ===" << endl;
+        testInMemoryPartitions();
+
+        cout << "\n=== Testing durable stream clones ===" << endl;
+        testDurableStreamClone();
+
+        cout << "\n=== Testing failed shared flushes ===" << endl;
+        testFailedRingFlush();
+
+        cout << "\n=== Testing import of line-per-message files ===" << endl;
+        testLegacyImport();
+
+        cout << "\n=== Testing reads between batched appends ===" << endl;
+        testReadsKeepBatching();
+
     } catch (const exception& e) {
         cerr << "Exception occurred: " << e.what() << endl;
+        return 1;
     }
 
+    if (failedChecks > 0) {
+        cerr << "Checks failed: " << failedChecks << endl;
+        return 1;
+    }
     return 0;
 }
 
@@ -113,25 +233,25 @@ void testPartitionStreamAllMsgStreams() {
     MsgStream originalStream(5);
     originalStream.appendMessage("Test Message 1");
     MsgStream copiedStream(originalStream);
-    cout << "Copy constructor test passed: " << (copiedStream.getMessageCount() == originalStream.getMessageCount()) << endl;
+    cout << "Copy constructor test passed: " << check(copiedStream.getMessageCount() == originalStream.getMessageCount()) << endl;
 
     // Test MsgStream copy assignment operator
     MsgStream assignedStream(5);
     assignedStream = originalStream;
-    cout << "Copy assignment operator test passed: " << (assignedStream.getMessageCount() == originalStream.getMessageCount()) << endl;
+    cout << "Copy assignment operator test passed: " << check(assignedStream.getMessageCount() == originalStream.getMessageCount()) << endl;
 
     // Test MsgStream move constructor
     MsgStream movedStream(std::move(originalStream));
-    cout << "Move constructor test passed: " << (movedStream.getMessageCount() == 1) << endl;
+    cout << "Move constructor test passed: " << check(movedStream.getMessageCount() == 1) << endl;
 
     // Test MsgStream move assignment operator
     MsgStream moveAssignedStream(5);
     moveAssignedStream = std::move(copiedStream);
-    cout << "Move assignment operator test passed: " << (moveAssignedStream.getMessageCount() == 1) << endl;
+    cout << "Move assignment operator test passed: " << check(moveAssignedStream.getMessageCount() == 1) << endl;
 
     // Test operator!
     MsgStream emptyStream(5);
-    cout << "Operator! test (should be true): " << (!emptyStream ? "Passed" : "Failed") << endl;
+    cout << "Operator! test (should be true): " << (check(!emptyStream) ? "Passed" : "Failed") << endl;
 
     // Test operator+
     MsgStream streamA(5);
@@ -143,21 +263,21 @@ void testPartitionStreamAllMsgStreams() {
     streamB.appendMessage("Message 4");
 
     MsgStream mergedStream = streamA + streamB;
-    cout << "Operator+ test passed: " << (mergedStream.getMessageCount() == 4) << endl;
+    cout << "Operator+ test passed: " << check(mergedStream.getMessageCount() == 4) << endl;
 
     // Test operator==
     MsgStream identicalStream(5);
     identicalStream.appendMessage("Message 1");
     identicalStream.appendMessage("Message 2");
 
-    cout << "Operator== test passed: " << (streamA == identicalStream ? "Passed" : "Failed") << endl;
+    cout << "Operator== test passed: " << (check(streamA == identicalStream) ? "Passed" : "Failed") << endl;
 
     // Test operator!=
-    cout << "Operator!= test passed: " << (streamA != streamB ? "Passed" : "Failed") << endl;
+    cout << "Operator!= test passed: " << (check(streamA != streamB) ? "Passed" : "Failed") << endl;
 
     // Test operator+=
     streamA += streamB;
-    cout << "Operator+= test passed: " << (streamA.getMessageCount() == 4) << endl << endl;
+    cout << "Operator+= test passed: " << check(streamA.getMessageCount() == 4) << endl << endl;
 
     cout << "All PartitionStream and MsgStream tests completed." << endl;
 }
@@ -301,4 +421,897 @@ void testPartitionStreamEdgeCases() {
     cout << "Partition count after reset: " << edgeCaseTester.getPartitionCount() << endl << endl;
 
     cout << "Additional edge case tests completed." << endl;
-}
\ No newline at end of file
+}
+
+// Reads a multi-hundred-MB log through mapped views and checks the heap does not grow with it
+void testDurableStreamMappedReads() {
+    const string filePath = "mapped_stream.txt";
+    const long long targetBytes = 256LL * 1024 * 1024;
+    const string payload(150, 'm');
+
+    long long written = 0;
+    {
+        SegmentedLog log(filePath);
+        log.clear();
+        while (log.getMessageCount() * static_cast<long long>(payload.size()) < targetBytes) {
+            log.append(payload);
+        }
+        written = log.getMessageCount();
+    }
+
+    DurableStream stream(200, filePath);
+    cout << "Messages in backing log: " << stream.getLogMessageCount()
+         << " (in memory: " << stream.getMessageCount() << ")" << endl;
+
+#ifdef __GLIBC__
+    size_t heapBefore = mallinfo2().uordblks;
+#endif
+
+    const long long window = written / 300 + 1;
+    long long bytesRead = 0;
+    size_t largestWindowHeap = 0;
+    for (long long start = 0; start < written; start += window) {
+        long long end = start + window < written ? start + window : written;
+        vector<string_view> views = stream.readMessageViews(start, end);
+        for (const string_view& view : views) {
+            bytesRead += view.size();
+        }
+#ifdef __GLIBC__
+        size_t heapNow = mallinfo2().uordblks;
+        if (heapNow > heapBefore && heapNow - heapBefore > largestWindowHeap) {
+            largestWindowHeap = heapNow - heapBefore;
+        }
+#endif
+    }
+
+    cout << "Mapped read test passed: " << check(bytesRead == written * static_cast<long long>(payload.size())) << endl;
+#ifdef __GLIBC__
+    cout << "Peak heap growth while reading " << bytesRead / (1024 * 1024) << " MB: "
+         << largestWindowHeap / 1024 << " KB" << endl;
+    cout << "Heap stays far below stream size: " << check(largestWindowHeap < static_cast<size_t>(targetBytes / 64)) << endl;
+#endif
+
+    stream.reset();
+    SegmentedLog(filePath).clear();
+    cout << "DurableStream memory-mapped read tests completed." << endl;
+}
+
+// Ingests far more messages than a ring-buffer stream retains and checks it keeps the latest ones with bounded memory
+void testMsgStreamRetention() {
+    const int retained = 100;
+    MsgStream tail(retained, CapacityMode::Fixed, RetentionPolicy::keepLatest());
+
+    for (int i = 0; i < 1000; i++) {
+        tail.appendMessage("Message " + to_string(i));
+    }
+    cout << "Retained messages: " << tail.getMessageCount() << " of offsets ["
+         << tail.getFirstOffset() << ", " << tail.getNextOffset() << ")" << endl;
+
+    auto messages = tail.readMessages(995, 996);
+    cout << "Read by logical offset: " << messages[0] << endl;
+
+    try {
+        tail.readMessages(0, 1); // Long since evicted
+    } catch (const out_of_range& e) {
+        cout << "Caught expected error for evicted offset: " << e.what() << endl;
+    }
+
+    size_t storageAfterWarmup = tail.getStorageBytes();
+    for (int i = 1000; i < 100000; i++) {
+        tail.appendMessage("Message " + to_string(i));
+    }
+    cout << "Storage stays bounded: " << check(tail.getStorageBytes() == storageAfterWarmup) << endl;
+
+    MsgStream byteTail(retained, CapacityMode::Fixed, RetentionPolicy::keepLatestBytes(1000));
+    for (int i = 0; i < 1000; i++) {
+        byteTail.appendMessage(string(100, 'b'));
+    }
+    cout << "Byte-bounded stream retains: " << byteTail.getMessageCount() << " messages" << endl;
+
+    cout << "MsgStream retention tests completed." << endl;
+}
+
+// Addresses partitions by reassigned integer keys and by string keys claimed on first write
+void testPartitionStreamKeys() {
+    PartitionStream keyed(3, std::unique_ptr<MsgStream[]>(new MsgStream[3]));
+    for (int i = 0; i < 3; i++) {
+        keyed.initializeMsgStream(i, 5);
+    }
+
+    keyed.setPartitionKey(0, 1001);
+    keyed.writeMessage(1001, "Message for key 1001");
+    cout << "Read from reassigned key 1001: " << keyed.readMessage(1001, 0, 1)[0] << endl;
+
+    try {
+        keyed.writeMessage(1, "Old key no longer valid");
+    } catch (const runtime_error& e) {
+        cout << "Caught expected error for replaced key: " << e.what() << endl;
+    }
+
+    try {
+        keyed.setPartitionKey(1, 1001);
+    } catch (const invalid_argument& e) {
+        cout << "Caught expected error for duplicate key: " << e.what() << endl;
+    }
+
+    PartitionStream named(3, std::unique_ptr<MsgStream[]>(new MsgStream[3]), CapacityMode::Growable);
+    for (int i = 0; i < 3; i++) {
+        named.initializeMsgStream(i, 5);
+    }
+
+    named.writeMessage(string("orders"), "First order");
+    named.writeMessage(string("payments"), "First payment");
+    named.writeMessage(string("orders"), "Second order");
+    cout << "Read from string key orders: " << named.readMessage(string("orders"), 1, 2)[0] << endl;
+    cout << "Read from string key payments: " << named.readMessage(string("payments"), 0, 1)[0] << endl;
+
+    named.writeMessage(string("refunds"), "First refund");
+    try {
+        named.writeMessage(string("audits"), "No partition left");
+    } catch (const overflow_error& e) {
+        cout << "Caught expected error for fourth string key: " << e.what() << endl;
+    }
+
+    cout << "PartitionStream key tests completed." << endl;
+}
+
+// Hammers one PartitionStream from many producer threads and checks no write is lost or counted past a limit
+void testPartitionStreamConcurrentWrites() {
+    const int threadCount = 8;
+    const int partitions = 64;
+    const int writesPerThread = 20000;
+
+    PartitionStream shared(partitions, std::unique_ptr<MsgStream[]>(new MsgStream[partitions]), CapacityMode::Growable);
+    for (int i = 0; i < partitions; i++) {
+        shared.initializeMsgStream(i, threadCount * writesPerThread);
+    }
+
+    vector<thread> producers;
+    for (int t = 0; t < threadCount; t++) {
+        producers.emplace_back([&shared, t]() {
+            for (int i = 0; i < writesPerThread; i++) {
+                if (i % 10 == 0) {
+                    shared.writeMessage("producer-" + to_string(t), "Named message " + to_string(i));
+                } else {
+                    shared.writeMessage((i * 7 + t) % partitions + 1, "Message " + to_string(i) + " from " + to_string(t));
+                }
+            }
+        });
+    }
+    for (thread& producer : producers) {
+        producer.join();
+    }
+
+    int stored = 0;
+    for (int i = 0; i < partitions; i++) {
+        stored += shared[i].getMessageCount();
+    }
+    cout << "Concurrent writes all stored: " << check(stored == threadCount * writesPerThread) << endl;
+    cout << "Shared write counter matches: " << check(shared.getPartitionCount() == threadCount * writesPerThread) << endl;
+
+    // A Fixed stream accepts capacity writes in total; racing producers must not push it past that
+    PartitionStream limited(50, std::unique_ptr<MsgStream[]>(new MsgStream[50]));
+    for (int i = 0; i < 50; i++) {
+        limited.initializeMsgStream(i, 50);
+    }
+    atomic<int> accepted(0);
+    producers.clear();
+    for (int t = 0; t < threadCount; t++) {
+        producers.emplace_back([&limited, &accepted, t]() {
+            for (int i = 0; i < 100; i++) {
+                try {
+                    limited.writeMessage((i + t) % 50 + 1, "Racing message");
+                    accepted++;
+                } catch (const runtime_error&) {
+                }
+            }
+        });
+    }
+    for (thread& producer : producers) {
+        producer.join();
+    }
+    cout << "Racing writes stop exactly at capacity: " << check(accepted == limited.getCapacity()) << endl;
+
+    cout << "PartitionStream concurrent write tests completed." << endl;
+}
+
+// One thread appends while several readers scan the committed tail without locks and check every message they see
+void testMsgStreamConcurrentReaders() {
+    const int messageCount = 200000;
+    const int readerCount = 4;
+
+    MsgStream stream(messageCount, CapacityMode::Growable);
+    atomic<int> mismatches(0);
+    atomic<long long> messagesChecked(0);
+
+    vector<thread> readers;
+    for (int r = 0; r < readerCount; r++) {
+        readers.emplace_back([&stream, &mismatches, &messagesChecked]() {
+            long long seen = 0;
+            while (seen < messageCount) {
+                long long committed = stream.getCommittedCount();
+                if (committed == seen) {
+                    this_thread::yield();
+                    continue;
+                }
+                long long first = committed - 64 > seen ? committed - 64 : seen;
+                MessageRange range = stream.viewCommitted(first, committed);
+                for (int i = 0; i < range.size(); i++) {
+                    if (range[i] != "Message " + to_string(first + i)) {
+                        mismatches++;
+                    }
+                }
+                messagesChecked += range.size();
+                seen = committed;
+            }
+        });
+    }
+
+    for (int i = 0; i < messageCount; i++) {
+        stream.appendMessage("Message " + to_string(i));
+    }
+    for (thread& reader : readers) {
+        reader.join();
+    }
+
+    cout << "Readers saw only complete messages: " << check(mismatches == 0) << endl;
+    cout << "Readers checked messages while appending: " << check(messagesChecked > 0) << endl;
+
+    try {
+        stream.viewCommitted(0, messageCount + 1);
+    } catch (const out_of_range& e) {
+        cout << "Caught expected error for uncommitted range: " << e.what() << endl;
+    }
+
+    cout << "MsgStream concurrent reader tests completed." << endl;
+}
+
+// Writes through PartitionStream into DurableStream partitions and checks the messages reach the backing log
+void testPartitionStreamDurablePartitions() {
+    const string filePath = "partition_durable.txt";
+    SegmentedLog(filePath).clear();
+
+    {
+        vector<unique_ptr<MsgStream>> partitions;
+        partitions.push_back(unique_ptr<MsgStream>(new DurableStream(10, filePath)));
+        partitions.push_back(unique_ptr<MsgStream>(new MsgStream(10)));
+        PartitionStream mixed(move(partitions), CapacityMode::Growable);
+
+        mixed.writeMessage(1, "Durable message 1");
+        mixed.writeMessage(1, "Durable message 2");
+        mixed.writeMessage(2, "In-memory message");
+
+        cout << "Partition 1 is durable: " << check(dynamic_cast<DurableStream*>(&mixed[0]) != nullptr) << endl;
+        cout << "Partition 2 is in-memory: " << check(dynamic_cast<DurableStream*>(&mixed[1]) == nullptr) << endl;
+    }
+
+    // A fresh stream on the same file sees what was written through the PartitionStream
+    DurableStream reopened(10, filePath);
+    cout << "Messages persisted through PartitionStream: " << reopened.getMessageCount() << endl;
+    cout << "Persisted message: " << reopened.readMessages(1, 2)[0] << endl;
+
+    {
+        PartitionStream replaced(2, std::unique_ptr<MsgStream[]>(new MsgStream[2]));
+        replaced.setPartition(0, unique_ptr<MsgStream>(new DurableStream(10, filePath)));
+        replaced.writeMessage(1, "Durable message 3");
+    }
+    cout << "Injected partition appends to the log: " << check(DurableStream(10, filePath).getMessageCount() == 3) << endl;
+
+    reopened.reset();
+    SegmentedLog(filePath).clear();
+    cout << "PartitionStream durable partition tests completed." << endl;
+}
+
+void testBatchAppend() {
+    MsgStream stream(10);
+    stream.appendBatch(vector<string>{ "Batch message 1", "Batch message 2", "Batch message 3" });
+    cout << "Messages after batch: " << stream.getMessageCount() << endl;
+    cout << "Last batched message: " << stream.readMessages(2, 3)[0] << endl;
+
+    try {
+        stream.appendBatch(vector<string>{ "Batch message 4", "" });
+    } catch (const exception& e) {
+        cout << "Rejected batch: " << e.what() << " Messages still: " << stream.getMessageCount() << endl;
+    }
+
+    const string filePath = "batch_durable.txt";
+    SegmentedLog(filePath).clear();
+    {
+        DurableStream durable(10, filePath, DurabilityPolicy::everyMessages(100));
+        durable.appendBatch(vector<string>{ "Durable batch 1", "Durable batch 2" });
+    }
+    cout << "Durable batch persisted: " << check(DurableStream(10, filePath).getMessageCount() == 2) << endl;
+    SegmentedLog(filePath).clear();
+
+    PartitionStream partitions(3, std::unique_ptr<MsgStream[]>(new MsgStream[3]), CapacityMode::Growable);
+    for (int i = 0; i < 3; i++) {
+        partitions.initializeMsgStream(i, 10);
+    }
+    partitions.writeBatch({ { 1, "First to 1" }, { 3, "First to 3" }, { 1, "Second to 1" } });
+    cout << "Partition 1 keeps batch order: " << partitions.readMessage(1, 0, 1)[1] << endl;
+    cout << "Partition 3 messages: " << partitions[2].getMessageCount() << endl;
+
+    try {
+        partitions.writeBatch({ { 2, "Valid" }, { 7, "Unknown key" } });
+    } catch (const exception& e) {
+        cout << "Rejected batch: " << e.what() << " Partition 2 messages: " << partitions[1].getMessageCount() << endl;
+    }
+    cout << "Batch append tests completed." << endl;
+}
+
+void testEmplaceMessage() {
+    MsgStream stream(10);
+    const char* buffer = "View message with trailing bytes";
+    stream.appendMessage(string_view(buffer, 12));
+    stream.emplaceMessage(5, [](char* destination) {
+        memcpy(destination, "Built", 5);
+    });
+    cout << "Appended view: " << stream.readMessages(0, 1)[0] << endl;
+    cout << "Emplaced message: " << stream.readMessages(1, 2)[0] << endl;
+
+    // The range iterator supports the full random-access interface, so standard algorithms take it as one
+    MessageRange range = stream.viewMessages(0, 2);
+    MessageRange::iterator second = 1 + range.begin();
+    cout << "Iterator comparisons hold: "
+         << check(second > range.begin() && second <= range.end() - 1 && range.end() >= second && second - 1 < second)
+         << ", second message length: " << second->size()
+         << ", index found by search: " << (find(range.begin(), range.end(), "Built") - range.begin()) << endl;
+
+    try {
+        stream.emplaceMessage(0, [](char*) {});
+    } catch (const exception& e) {
+        cout << "Rejected empty emplace: " << e.what() << endl;
+    }
+
+    PartitionStream partitions(2, std::unique_ptr<MsgStream[]>(new MsgStream[2]), CapacityMode::Growable);
+    partitions.initializeMsgStream(1, 10);
+    partitions.emplaceMessage(2, 9, [](char* destination) {
+        memcpy(destination, "Partition", 9);
+    });
+    cout << "Emplaced into partition 2: " << partitions[1].getMessageCount() << endl;
+    cout << "Emplace tests completed." << endl;
+}
+
+void testOperationBudgets() {
+    MsgStream limited(2);
+    limited.appendMessage("Budget message");
+    for (int i = 0; i < 3; i++) {
+        limited.viewMessages(0, 1);
+    }
+    try {
+        limited.viewMessages(0, 1);
+    } catch (const exception& e) {
+        cout << "Lifetime budget exhausted: " << e.what() << endl;
+    }
+
+    limited.setOperationBudget(BudgetPolicy::unlimited());
+    for (int i = 0; i < 1000; i++) {
+        limited.viewMessages(0, 1);
+    }
+    cout << "Unlimited budget served 1000 reads: " << check(limited.getMaxOperations() == INT_MAX) << endl;
+
+    limited.setOperationBudget(BudgetPolicy::tokenBucket(1000, 5));
+    int served = 0;
+    try {
+        for (int i = 0; i < 10; i++) {
+            limited.viewMessages(0, 1);
+            served++;
+        }
+    } catch (const exception& e) {
+        cout << "Token bucket burst served: " << served << endl;
+    }
+    this_thread::sleep_for(chrono::milliseconds(20));
+    limited.viewMessages(0, 1);
+    cout << "Token bucket refilled after waiting: 1" << endl;
+
+    PartitionStream tenants(2, std::unique_ptr<MsgStream[]>(new MsgStream[2]), CapacityMode::Growable);
+    tenants.setPartitionBudget(BudgetPolicy::lifetime(3));
+    tenants.initializeMsgStream(0, 10);
+    tenants.initializeMsgStream(1, 10);
+    for (int i = 0; i < 3; i++) {
+        tenants.writeMessage(1, "Busy tenant");
+    }
+    try {
+        tenants.writeMessage(1, "Busy tenant");
+    } catch (const exception& e) {
+        cout << "Busy partition refused: " << e.what() << endl;
+    }
+    tenants.writeMessage(2, "Quiet tenant");
+    cout << "Quiet partition still writable: " << expect(tenants[1].getMessageCount(), 1) << endl;
+    cout << "Operation budget tests completed." << endl;
+}
+
+void testDurableStreamRecovery() {
+    const string filePath = "recovery_stream.txt";
+    SegmentedLog(filePath).clear();
+    {
+        DurableStream stream(10, filePath, DurabilityPolicy::everyMessages(1));
+        stream.appendMessage("Survives the crash 1");
+        stream.appendMessage("Survives the crash 2");
+    }
+
+    // Simulate a crash in the middle of writing a record: a header promising more bytes than were written
+    {
+        ofstream segment(filePath + ".00000000000000000000.log", ios::app | ios::binary);
+        const char torn[] = { 40, 0, 0, 0, 1, 2, 3, 4, 'p', 'a', 'r', 't' };
+        segment.write(torn, sizeof(torn));
+    }
+
+    {
+        DurableStream recovered(10, filePath);
+        RecoveryReport report = recovered.getRecoveryReport();
+        cout << "Messages after recovery: " << recovered.getMessageCount() << endl;
+        cout << "Torn bytes truncated: " << report.bytesTruncated << endl;
+        recovered.appendMessage("Written after recovery");
+    }
+
+    DurableStream reopened(10, filePath);
+    cout << "Append after recovery is readable: " << reopened.readMessages(2, 3)[0] << endl;
+
+    reopened.reset();
+    SegmentedLog(filePath).clear();
+    cout << "DurableStream recovery tests completed." << endl;
+}
+
+void testDurableStreamReset() {
+    const string filePath = "reset_stream.txt";
+    SegmentedLog(filePath).clear();
+    {
+        DurableStream stream(10, filePath);
+        stream.appendMessage("Initial 1");
+        stream.appendMessage("Initial 2");
+    }
+
+    {
+        DurableStream stream(10, filePath);
+        stream.appendMessage("Dropped by reset 1");
+        stream.appendMessage("Dropped by reset 2");
+        stream.reset();
+        cout << "Log messages after reset: " << stream.getLogMessageCount() << endl;
+        stream.appendMessage("Written after reset");
+    }
+
+    DurableStream reopened(10, filePath);
+    unique_ptr<string[]> messages = reopened.readMessages(0, reopened.getMessageCount());
+    for (int i = 0; i < reopened.getMessageCount(); i++) {
+        cout << "Message " << i << " after reopening: " << messages[i] << endl;
+    }
+
+    // An independent handle must see the reset even after the log grows past the size it last saw
+    {
+        DurableStream writer(50, filePath);
+        DurableStream reader(50, filePath);
+        reader.appendMessage("Dropped by reset 3");
+        reader.appendMessage("Dropped by reset 4");
+        reader.flush();
+
+        writer.reset();
+        for (int i = 0; i < 5; i++) {
+            writer.appendMessage("Appended after reset " + to_string(i));
+        }
+        writer.flush();
+
+        unique_ptr<string[]> seen = reader.readMessages(0, 1);
+        int count = reader.getMessageCount();
+        seen = reader.readMessages(0, count);
+        cout << "Other handle sees " << expect(count, 8) << " messages, log holds "
+             << expect(reader.getLogMessageCount(), 8LL) << ", message 3: "
+             << expect(seen[3], string("Appended after reset 0")) << endl;
+    }
+
+    // Snapshots resume after a reset cuts many segments away; they are written every 8 segment rolls
+    SegmentedLog(filePath).clear();
+    {
+        SegmentedLog log(filePath, 32);
+        for (int i = 0; i < 24; i++) {
+            log.append("One per segment");
+        }
+        log.truncate(1);
+        cout << "Snapshot after truncating: " << expect(filesystem::exists(filePath + ".snapshot"), false) << endl;
+        for (int i = 0; i < 9; i++) {
+            log.append("One per segment");
+        }
+        cout << "Snapshot once segments roll again: " << check(filesystem::exists(filePath + ".snapshot")) << endl;
+    }
+
+    SegmentedLog(filePath).clear();
+    cout << "DurableStream reset tests completed." << endl;
+}
+
+void testBackgroundFlush() {
+    const string filePath = "background_stream.txt";
+    SegmentedLog(filePath).clear();
+    {
+        DurableStream stream(50, filePath, DurabilityPolicy::background(8, 5, false));
+        for (int i = 1; i <= 20; i++) {
+            stream.appendMessage("Background message " + to_string(i));
+        }
+        stream.flush();
+        cout << "Messages in the log after flush: " << stream.getLogMessageCount() << endl;
+
+        // Switching back to a foreground policy drains the queue first
+        stream.appendMessage("Queued before switching policy");
+        stream.setDurabilityPolicy(DurabilityPolicy::everyMessages(1));
+        stream.appendMessage("Written in the foreground");
+    }
+
+    // A record of the largest size the log accepts must fit in the ring, or enqueue would wait forever
+    {
+        SegmentedLog log(filePath);
+        BackgroundFlusher flusher(log, 0, 0);
+        flusher.enqueue(string(SegmentedLog::MAX_RECORD_SIZE, 'x'));
+        flusher.barrier();
+        cout << "Largest record written: " << check(log.read(22).size() == SegmentedLog::MAX_RECORD_SIZE) << endl;
+        log.truncate(22);
+    }
+
+    DurableStream reopened(50, filePath);
+    cout << "Messages after reopening: " << reopened.getMessageCount() << endl;
+    cout << "Last message: " << reopened.readMessages(21, 22)[0] << endl;
+
+    SegmentedLog(filePath).clear();
+    cout << "DurableStream background flush tests completed." << endl;
+}
+
+void testSharedPartitionFlush() {
+    const int partitionCount = 4;
+    vector<unique_ptr<MsgStream>> partitions;
+    for (int i = 0; i < partitionCount; i++) {
+        string filePath = "shared_flush_" + to_string(i) + ".txt";
+        SegmentedLog(filePath).clear();
+        partitions.push_back(unique_ptr<MsgStream>(new DurableStream(10, filePath, DurabilityPolicy::onDemand(false))));
+    }
+
+    {
+        PartitionStream stream(move(partitions), CapacityMode::Growable);
+        for (int key = 1; key <= partitionCount; key++) {
+            stream.writeMessage(key, "Shared flush message " + to_string(key));
+        }
+
+        // Nothing reaches the files until the partitions are flushed together
+        const string firstSegment = "shared_flush_0.txt.00000000000000000000.log";
+        cout << "Bytes on disk before flush: " << expect(filesystem::file_size(firstSegment), static_cast<uintmax_t>(0)) << endl;
+
+        IoRing ring;
+        stream.flushDurablePartitions(ring);
+        cout << "Bytes on disk after flush: " << filesystem::file_size(firstSegment) << endl;
+        cout << "One system call per ring-full of writes: "
+             << check(ring.getSystemCalls() == (ring.usesUring() ? 1 : 2 * partitionCount)) << endl;
+
+        stream.writeMessage(1, "Written by the fallback");
+        IoRing fallback(IoRing::DEFAULT_ENTRIES, false);
+        stream.flushDurablePartitions(fallback);
+    }
+
+    // A synced write needs two entries, so a one-entry ring could never submit it
+    try {
+        IoRing tooSmall(1);
+    } catch (const exception& e) {
+        cout << "Caught exception: " << e.what() << endl;
+    }
+
+    DurableStream reopened(10, "shared_flush_0.txt");
+    cout << "Messages after reopening: " << reopened.getMessageCount() << endl;
+    cout << "Last message: " << reopened.readMessages(1, 2)[0] << endl;
+
+    for (int i = 0; i < partitionCount; i++) {
+        SegmentedLog("shared_flush_" + to_string(i) + ".txt").clear();
+    }
+    cout << "PartitionStream shared flush tests completed." << endl;
+}
+
+// Test counters, rejections, latency histograms and the Prometheus export
+void testStreamMetrics() {
+    MsgStream stream(3);
+    stream.appendMessage("Before metrics");
+    cout << "Metrics enabled by default: " << expect(stream.hasMetrics(), false) << endl;
+
+    stream.enableMetrics();
+    stream.appendMessage("First counted");
+    stream.appendMessage("Second counted");
+    try {
+        stream.appendMessage("Over capacity");
+    } catch (const exception& e) {
+        cout << "Caught exception: " << e.what() << endl;
+    }
+    try {
+        stream.readMessages(5, 6);
+    } catch (const exception& e) {
+        cout << "Caught exception: " << e.what() << endl;
+    }
+    try {
+        stream.emplaceMessage(0, [](char*) {});
+    } catch (const exception& e) {
+        cout << "Caught exception: " << e.what() << endl;
+    }
+    stream.readMessages(0, 2);
+
+    StreamMetricsSnapshot metrics = stream.getMetrics();
+    cout << "Appends: " << metrics.appends << ", bytes: " << metrics.bytesAppended << endl;
+    cout << "Reads: " << metrics.reads << ", messages read: " << metrics.messagesRead << endl;
+    cout << "Rejected full: " << metrics.getRejections(RejectReason::Full)
+         << ", invalid: " << metrics.getRejections(RejectReason::Invalid) << endl;
+    cout << "Append latency samples: " << metrics.appendLatency.count << endl;
+
+    // Buckets keep values within 12.5% of their bounds
+    LatencyHistogram histogram;
+    for (int i = 1; i <= 1000; i++) {
+        histogram.record(i * 1000);
+    }
+    HistogramSnapshot samples = histogram.snapshot();
+    long long median = samples.percentile(0.5);
+    cout << "Median within 12.5% of 500us: " << check(median >= 500000 && median <= 562500) << endl;
+
+    const string filePath = "metrics_stream.txt";
+    SegmentedLog(filePath).clear();
+    {
+        DurableStream durable(10, filePath, DurabilityPolicy::everyMessages(2));
+        durable.enableMetrics();
+        durable.appendMessage("Durable one");
+        durable.appendMessage("Durable two");
+        durable.readMessages(0, 1);
+        StreamMetricsSnapshot durableMetrics = durable.getMetrics();
+        cout << "Flushes: " << durableMetrics.flushes << ", bytes flushed: " << durableMetrics.bytesFlushed << endl;
+        cout << "Syncs: " << durableMetrics.syncs << endl;
+    }
+    SegmentedLog(filePath).clear();
+
+    unique_ptr<MsgStream[]> streams(new MsgStream[2]);
+    PartitionStream partitions(2, move(streams), CapacityMode::Growable);
+    partitions.initializeMsgStream(0, 5);
+    partitions.initializeMsgStream(1, 5);
+    partitions.enableMetrics();
+    partitions.writeMessage(1, "Partition one");
+    partitions.writeMessage(2, "Partition two");
+    partitions.writeMessage(2, "Partition two again");
+    try {
+        partitions.writeMessage(9, "No such partition");
+    } catch (const exception& e) {
+        cout << "Caught exception: " << e.what() << endl;
+    }
+
+    PartitionMetrics partitionMetrics = partitions.getMetrics();
+    cout << "Partition 2 appends: " << partitionMetrics.partitions[1].appends << endl;
+    cout << "Total appends: " << partitionMetrics.total().appends
+         << ", rejected: " << partitionMetrics.total().getTotalRejections() << endl;
+
+    string text = partitionMetrics.toPrometheus("partition_stream");
+    cout << "Exports partition series: "
+         << check(text.find("partition_stream_partition_appends_total{partition=\"2\"} 2") != string::npos) << endl;
+    cout << "Exports rejections by reason: "
+         << check(text.find("partition_stream_rejected_total{reason=\"invalid\"} 1") != string::npos) << endl;
+
+    StreamMetrics::writePrometheusFile("metrics_stream.prom", text);
+    cout << "Metrics file written: " << check(filesystem::exists("metrics_stream.prom")) << endl;
+    filesystem::remove("metrics_stream.prom");
+    cout << "Stream metrics tests completed." << endl;
+}
+
+// Test the policy-configured stream alongside the default MsgStream
+void testStreamPolicies() {
+    MsgStream checked(2);
+    try {
+        checked.appendMessage("");
+    } catch (const exception& e) {
+        cout << "Caught exception: " << e.what() << endl;
+    }
+    cout << "Default max operations: " << checked.getMaxOperations() << endl;
+
+    TrustedMsgStream trusted(2);
+    cout << "Trusted max operations: " << trusted.getMaxOperations() << endl;
+    int operations = 0;
+    for (int round = 0; round < 3; round++) {
+        trusted.appendMessage("Trusted one");
+        trusted.appendMessage("Trusted two");
+        trusted.readMessages(0, 1);
+        trusted.reset();
+        operations += 3;
+    }
+    cout << "Operations admitted without a budget: " << operations << endl;
+
+    try {
+        trusted.appendMessage("Trusted one");
+        trusted.appendMessage("Trusted two");
+        trusted.appendMessage("Trusted three");
+    } catch (const exception& e) {
+        cout << "Caught exception: " << e.what() << endl;
+    }
+
+    try {
+        trusted.setOperationBudget(BudgetPolicy::lifetime(10));
+    } catch (const exception& e) {
+        cout << "Caught exception: " << e.what() << endl;
+    }
+    trusted.setOperationBudget(BudgetPolicy::unlimited());
+
+    unique_ptr<TrustedMsgStream> copy = trusted.clone();
+    cout << "Clone equal to original: " << check(*copy == trusted) << endl;
+    cout << "Stream policies tests completed." << endl;
+}
+
+// Test that partitions created by PartitionStream are InMemoryStreams and mix with injected durable ones
+void testInMemoryPartitions() {
+    unique_ptr<MsgStream[]> streams(new MsgStream[2]);
+    PartitionStream partitions(2, move(streams), CapacityMode::Growable);
+    partitions.initializeMsgStream(0, 5);
+    cout << "Array partition is in-memory: " << check(dynamic_cast<InMemoryStream*>(&partitions[1]) != nullptr) << endl;
+    cout << "Initialized partition is in-memory: " << check(dynamic_cast<InMemoryStream*>(&partitions[0]) != nullptr) << endl;
+
+    const string filePath = "in_memory_partitions.txt";
+    SegmentedLog(filePath).clear();
+    {
+        partitions.setPartition(1, unique_ptr<MsgStream>(new DurableStream(5, filePath)));
+        partitions.writeMessage(1, "In memory");
+        partitions.writeMessage(2, "On disk");
+        partitions.writeBatch({ { 1, "Batch in memory" }, { 2, "Batch on disk" } });
+
+        unique_ptr<string[]> memory = partitions.readMessage(1, 0, 1);
+        cout << "In-memory partition: " << memory[0] << ", " << memory[1] << endl;
+        MessageRange disk = partitions.viewMessage(2, 0, 2);
+        cout << "Durable partition: " << disk[0] << ", " << disk[1] << endl;
+        cout << "Durable partition kept its type: " << check(dynamic_cast<DurableStream*>(&partitions[1]) != nullptr) << endl;
+
+        InMemoryStream direct(3);
+        direct.appendMessage("Direct");
+        unique_ptr<MsgStream> copy = direct.clone();
+        cout << "Clone is in-memory: " << check(dynamic_cast<InMemoryStream*>(copy.get()) != nullptr)
+             << ", equal: " << check(*copy == direct) << endl;
+    }
+    SegmentedLog(filePath).clear();
+    cout << "In-memory partition tests completed." << endl;
+}
+
+// Test that a clone appends through its original's log instead of a second writer on the same files
+void testDurableStreamClone() {
+    const string filePath = "clone_stream.txt";
+    SegmentedLog(filePath).clear();
+    {
+        DurableStream original(20, filePath, DurabilityPolicy::everyMessages(3));
+        unique_ptr<MsgStream> copy = original.clone();
+        DurableStream& clone = dynamic_cast<DurableStream&>(*copy);
+
+        for (int i = 0; i < 6; i++) {
+            DurableStream& writer = i % 2 == 0 ? original : clone;
+            writer.appendMessage("msg" + to_string(i));
+        }
+
+        cout << "Log messages seen by original: " << original.getLogMessageCount()
+             << ", by clone: " << clone.getLogMessageCount() << endl;
+
+        for (DurableStream* stream : { &original, &clone }) {
+            vector<string_view> views = stream->readMessageViews(0, 6);
+            unique_ptr<string[]> memory = stream->readMessages(0, 5);
+            bool consistent = views.size() == 6;
+            for (int i = 0; consistent && i < 6; i++) {
+                consistent = views[i] == "msg" + to_string(i) && memory[i] == views[i];
+            }
+            cout << (stream == &original ? "Original" : "Clone") << " memory matches log views: " << check(consistent) << endl;
+        }
+
+        try {
+            clone.setDurabilityPolicy(DurabilityPolicy::everyMessages(1));
+        } catch (const exception& e) {
+            cout << "Caught exception: " << e.what() << endl;
+        }
+
+        clone.reset();
+        original.appendMessage("after reset");
+        cout << "Original after clone reset: " << original.getMessageCount() << " message, "
+             << original.readMessages(0, 1)[0] << endl;
+    }
+    {
+        DurableStream reopened(20, filePath);
+        cout << "Messages on disk after reopening: " << reopened.getLogMessageCount() << endl;
+    }
+    SegmentedLog(filePath).clear();
+    cout << "Durable stream clone tests completed." << endl;
+}
+
+// A submit that fails part-way must leave the unwritten records with the log so a later flush completes them
+void testFailedRingFlush() {
+    const string filePath = "failed_flush.txt";
+    const string segment = filePath + ".00000000000000000000.log";
+    rlimit original;
+    getrlimit(RLIMIT_FSIZE, &original);
+    signal(SIGXFSZ, SIG_IGN);
+
+    for (bool useUring : { true, false }) {
+        SegmentedLog(filePath).clear();
+        {
+            SegmentedLog log(filePath);
+            for (int i = 0; i < 3; i++) {
+                log.append("Record written past the limit " + to_string(i));
+            }
+
+            // Let only the first few bytes of the segment reach the disk. The limit applies to every file, so nothing
+            // is printed until it is lifted: output redirected to a file would be cut off too.
+            IoRing ring(IoRing::DEFAULT_ENTRIES, useUring);
+            log.queueFlush(ring);
+            string error = "none";
+            rlimit limited = original;
+            limited.rlim_cur = 10;
+            setrlimit(RLIMIT_FSIZE, &limited);
+            try {
+                ring.submit();
+            } catch (const exception& e) {
+                error = e.what();
+            }
+            setrlimit(RLIMIT_FSIZE, &original);
+            cout << "Caught exception: " << error << endl;
+            cout << "Bytes on disk after the failed submit: " << filesystem::file_size(segment) << endl;
+
+            log.flush();
+        }
+
+        SegmentedLog reopened(filePath);
+        bool intact = reopened.getMessageCount() == 3;
+        for (int i = 0; intact && i < 3; i++) {
+            intact = reopened.read(i) == "Record written past the limit " + to_string(i);
+        }
+        cout << (useUring ? "Ring" : "Fallback") << " records intact after retrying: " << check(intact) << endl;
+    }
+
+    signal(SIGXFSZ, SIG_DFL);
+    SegmentedLog(filePath).clear();
+    cout << "Failed shared flush tests completed." << endl;
+}
+
+// A file in the old line-per-message format is imported into the log on first open, and only then
+void testLegacyImport() {
+    const string filePath = "legacy_stream.txt";
+    auto removeLog = [&]() {
+        for (const string extension : { ".00000000000000000000.log", ".00000000000000000000.idx", ".snapshot" }) {
+            filesystem::remove(filePath + extension);
+        }
+    };
+    removeLog();
+    {
+        ofstream legacy(filePath, ios::trunc);
+        legacy << "Legacy message 1" << endl << "Legacy message 2" << endl
+               << string(200, 'x') << endl << "Legacy message 3" << endl;
+    }
+
+    {
+        DurableStream stream(10, filePath);
+        cout << "Messages imported: " << expect(stream.getLogMessageCount(), 3LL) << endl;
+        cout << "Last imported message: " << stream.readMessages(2, 3)[0] << endl;
+        stream.appendMessage("Appended after import");
+        stream.flush();
+    }
+    {
+        DurableStream reopened(10, filePath);
+        cout << "Messages after reopening: " << expect(reopened.getLogMessageCount(), 4LL) << endl;
+        reopened.reset();
+        cout << "Messages after reset: " << expect(reopened.getLogMessageCount(), 4LL) << endl;
+    }
+
+    removeLog();
+    filesystem::remove(filePath);
+    cout << "Legacy import tests completed." << endl;
+}
+
+// Reads sync from the log, but must not write out a batch the durability policy is still collecting
+void testReadsKeepBatching() {
+    const string filePath = "batched_reads.txt";
+    const string segment = filePath + ".00000000000000000000.log";
+    SegmentedLog(filePath).clear();
+    {
+        DurableStream stream(10, filePath, DurabilityPolicy::everyMessages(4));
+        stream.enableMetrics();
+        bool batched = true;
+        for (int i = 0; i < 3; i++) {
+            stream.appendMessage("Batched message " + to_string(i));
+            batched = batched && stream.readMessages(i, i + 1)[0] == "Batched message " + to_string(i)
+                && stream.viewMessages(0, i + 1).size() == i + 1
+                && filesystem::file_size(segment) == 0;
+        }
+        cout << "Reads left the batch buffered: " << check(batched)
+             << ", flushes: " << stream.getMetrics().flushes << endl;
+
+        stream.appendMessage("Batched message 3");
+        cout << "Bytes on disk after the fourth append: " << check(filesystem::file_size(segment) > 0)
+             << ", flushes: " << stream.getMetrics().flushes << endl;
+    }
+    SegmentedLog(filePath).clear();
+    cout << "Batched read tests completed." << endl;
+}
@@ -3,36 +3,84 @@
 
 #include "PartitionStream.h"
 #include "MsgStream.h"
+#include "InMemoryStream.h"
+#include "DurableStream.h"
+#include "IoRing.h"
+#include "StreamMetrics.h"
 #include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
 #include <stdexcept>
 
 using namespace std;
 
 PartitionStream::PartitionStream(int initialCapacity, std::unique_ptr<MsgStream[]> msgStreams)
-    : streams(move(msgStreams)), partitionCount(0), operationCount(0)
+    : PartitionStream(initialCapacity, move(msgStreams), CapacityMode::Fixed) {}
+
+PartitionStream::PartitionStream(int initialCapacity, std::unique_ptr<MsgStream[]> msgStreams, CapacityMode mode)
+    : partitionCount(0), operationCount(0), capacityMode(mode), budgetPolicy(BudgetPolicy::unlimited()),
+      partitionBudget(BudgetPolicy::unlimited()), hasPartitionBudget(false)
 {
     capacity = verifyCapacity(initialCapacity);
-    keys = std::unique_ptr<int[]>(new int[capacity]);
+    setOperationBudget(defaultBudget());
+    inMemory.resize(capacity);
+    for (int i = 0; i < capacity; i++)
+    {
+        streams.push_back(unique_ptr<MsgStream>(new InMemoryStream(move(msgStreams[i]))));
+        trackPartition(i);
+    }
+    initializeKeys();
+}
+
+PartitionStream::PartitionStream(vector<unique_ptr<MsgStream>> partitions)
+    : PartitionStream(move(partitions), CapacityMode::Fixed) {}
 
+PartitionStream::PartitionStream(vector<unique_ptr<MsgStream>> partitions, CapacityMode mode)
+    : partitionCount(0), operationCount(0), capacityMode(mode), budgetPolicy(BudgetPolicy::unlimited()),
+      partitionBudget(BudgetPolicy::unlimited()), hasPartitionBudget(false)
+{
+    if (partitions.empty())
+        throw invalid_argument("A PartitionStream needs at least one partition.");
+
+    capacity = verifyCapacity(static_cast<int>(partitions.size()));
+    setOperationBudget(defaultBudget());
+    inMemory.resize(capacity);
     for (int i = 0; i < capacity; i++)
     {
-        keys[i] = i + 1;
+        if (!partitions[i])
+            throw invalid_argument("Partitions must not be null.");
+        streams.push_back(move(partitions[i]));
+        trackPartition(i);
     }
+    initializeKeys();
 }
 
 PartitionStream::PartitionStream(const PartitionStream& other)
+    : partitionCount(other.partitionCount.load()), operationCount(other.operationCount.load()),
+      budgetPolicy(other.budgetPolicy), rateBudget(other.rateBudget), partitionBudget(other.partitionBudget),
+      hasPartitionBudget(other.hasPartitionBudget), metrics(other.metrics ? new StreamMetrics() : nullptr)
 {
     capacity = other.capacity;
-    operationCount = other.operationCount;
-    partitionCount = other.partitionCount;
+    capacityMode = other.capacityMode;
+    lockCount = other.lockCount;
 
-    streams = std::unique_ptr<MsgStream[]>(new MsgStream[capacity]);
     keys = std::unique_ptr<int[]>(new int[capacity]);
+    partitionLocks = std::unique_ptr<mutex[]>(new mutex[lockCount]);
+    movedKeys = other.movedKeys;
+    namedKeys = other.namedKeys;
 
+    inMemory.resize(capacity);
     for (int i = 0; i < capacity; i++)
     {
-        streams[i] = other.streams[i];
+        streams.push_back(other.streams[i]->clone());
+        trackPartition(i);
         keys[i] = other.keys[i];
     }
 }
@@ -41,33 +89,70 @@ PartitionStream& PartitionStream::operator=(const PartitionStream& other)
 {
     if (this == &other) return *this;
 
-    std::unique_ptr<MsgStream[]> copiedStreams(new MsgStream[other.capacity]);
+    vector<unique_ptr<MsgStream>> copiedStreams;
     std::unique_ptr<int[]> copiedKeys(new int[other.capacity]);
-    
+    unordered_map<int, int> copiedMovedKeys(other.movedKeys);
+    unordered_map<string, int> copiedNamedKeys(other.namedKeys);
+
     for (int i = 0; i < other.capacity; i++)
     {
-        copiedStreams[i] = other.streams[i];
+        copiedStreams.push_back(other.streams[i]->clone());
         copiedKeys[i] = other.keys[i];
+        if (metrics)
+        {
+            copiedStreams[i]->enableMetrics();
+        }
+    }
+
+    if (lockCount != other.lockCount)
+    {
+        partitionLocks = std::unique_ptr<mutex[]>(new mutex[other.lockCount]);
+        lockCount = other.lockCount;
     }
 
     capacity = other.capacity;
-    operationCount = other.operationCount;
-    partitionCount = other.partitionCount;
+    operationCount = other.operationCount.load();
+    partitionCount = other.partitionCount.load();
+    capacityMode = other.capacityMode;
+    budgetPolicy = other.budgetPolicy;
+    rateBudget = other.rateBudget;
+    partitionBudget = other.partitionBudget;
+    hasPartitionBudget = other.hasPartitionBudget;
 
     streams = move(copiedStreams);
+    inMemory.assign(capacity, nullptr);
+    for (int i = 0; i < capacity; i++)
+    {
+        trackPartition(i);
+    }
     keys = move(copiedKeys);
+    movedKeys = move(copiedMovedKeys);
+    namedKeys = move(copiedNamedKeys);
 
     return *this;
 }
 
 PartitionStream::PartitionStream(PartitionStream&& other) noexcept
     : streams(std::move(other.streams)),
+      inMemory(std::move(other.inMemory)),
       keys(std::move(other.keys)),
+      movedKeys(std::move(other.movedKeys)),
+      namedKeys(std::move(other.namedKeys)),
+      partitionLocks(std::move(other.partitionLocks)),
       capacity(other.capacity),
-      partitionCount(other.partitionCount),
-      operationCount(other.operationCount)
+      lockCount(other.lockCount),
+      partitionCount(other.partitionCount.load()),
+      operationCount(other.operationCount.load()),
+      capacityMode(other.capacityMode),
+      budgetPolicy(other.budgetPolicy),
+      rateBudget(other.rateBudget),
+      partitionBudget(other.partitionBudget),
+      hasPartitionBudget(other.hasPartitionBudget),
+      ioRing(std::move(other.ioRing)),
+      metrics(std::move(other.metrics))
 {
     other.capacity = 0;
+    other.lockCount = 0;
     other.operationCount = 0;
     other.partitionCount = 0;
 }
@@ -77,73 +162,385 @@ PartitionStream& PartitionStream::operator=(PartitionStream&& other) noexcept
     if (this == &other) return *this;
 
     streams = move(other.streams);
+    inMemory = move(other.inMemory);
     keys = move(other.keys);
+    movedKeys = move(other.movedKeys);
+    namedKeys = move(other.namedKeys);
+    partitionLocks = move(other.partitionLocks);
 
     capacity = other.capacity;
-    operationCount = other.operationCount;
-    partitionCount = other.partitionCount;
+    lockCount = other.lockCount;
+    operationCount = other.operationCount.load();
+    partitionCount = other.partitionCount.load();
+    capacityMode = other.capacityMode;
+    budgetPolicy = other.budgetPolicy;
+    rateBudget = other.rateBudget;
+    partitionBudget = other.partitionBudget;
+    hasPartitionBudget = other.hasPartitionBudget;
+    ioRing = move(other.ioRing);
+    metrics = move(other.metrics);
 
     other.capacity = 0;
+    other.lockCount = 0;
     other.operationCount = 0;
     other.partitionCount = 0;
 
     return *this;
 }
 
-void PartitionStream::writeMessage(const int& key, const string& message)
+void PartitionStream::writeMessage(const int& key, string_view message)
 {
-    if (!validatePartitionKey(key))
-        throw runtime_error("Invalid key");
+    int index = findPartitionIndex(key);
+    if (index < 0)
+        throw rejected(RejectReason::Invalid, runtime_error("Invalid key"));
 
-    if (operationLimitReached())
-        throw runtime_error("Operation limit reached");
+    reserveWrite(message);
+    appendToPartition(index, message);
+}
 
-    if (isFull())
-        throw runtime_error("Stream is full");
+void PartitionStream::writeMessage(const string& key, string_view message)
+{
+    if (key.empty())
+        throw rejected(RejectReason::Invalid, runtime_error("Invalid key"));
 
-    if (!isValidMessage(message))
-        throw runtime_error("Invalid message");
+    reserveWrite(message);
+
+    int index = findPartitionIndex(key);
+    if (index < 0)
+    {
+        try
+        {
+            index = claimPartition(key);
+        }
+        catch (...)
+        {
+            releaseWrites(1);
+            throw;
+        }
+    }
+
+    appendToPartition(index, message);
+}
+
+void PartitionStream::writeBatch(const pair<int, string>* batch, int count)
+{
+    if (count < 0)
+        throw rejected(RejectReason::Invalid, invalid_argument("Invalid batch size."));
+
+    if (count == 0)
+        return;
+
+    vector<pair<int, int>> order;
+    order.reserve(count);
+    for (int i = 0; i < count; i++)
+    {
+        int index = findPartitionIndex(batch[i].first);
+        if (index < 0)
+            throw rejected(RejectReason::Invalid, runtime_error("Invalid key"));
+        order.emplace_back(index, i);
+    }
+
+    reserveWrites(count);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (!isValidMessage(batch[i].second))
+        {
+            releaseWrites(count);
+            throw rejected(RejectReason::Invalid, runtime_error("Invalid message"));
+        }
+    }
+
+    // Sorting (index, position) pairs groups each partition's messages together while keeping their batch order.
+    sort(order.begin(), order.end());
+
+    vector<string_view> group;
+    int written = 0;
+    for (int first = 0; first < count; )
+    {
+        int index = order[first].first;
+        int last = first;
+        group.clear();
+        while (last < count && order[last].first == index)
+        {
+            group.push_back(batch[order[last].second].second);
+            last++;
+        }
+
+        {
+            lock_guard<mutex> guard(partitionLock(index));
+            try
+            {
+                int size = static_cast<int>(group.size());
+                withPartition(index, [&](auto& stream) { stream.appendBatch(group.data(), size); });
+            }
+            catch (...)
+            {
+                releaseWrites(count - written);
+                throw;
+            }
+        }
+
+        written += last - first;
+        first = last;
+    }
+}
+
+void PartitionStream::writeBatch(const vector<pair<int, string>>& batch)
+{
+    writeBatch(batch.data(), static_cast<int>(batch.size()));
+}
+
+unique_ptr<string[]> PartitionStream::readMessage(const int& key, long long startRange, long long endRange)
+{
+    int index = findPartitionIndex(key);
+    if (index < 0)
+        throw rejected(RejectReason::Invalid, runtime_error("Invalid key"));
+
+    if (operationLimitReached())
+        throw rejected(RejectReason::OperationLimit, runtime_error("Operation limit reached"));
+
+    lock_guard<mutex> guard(partitionLock(index));
+    return withPartition(index, [&](auto& stream) { return stream.readMessages(startRange, endRange); });
+}
 
+unique_ptr<string[]> PartitionStream::readMessage(const string& key, long long startRange, long long endRange)
+{
     int index = findPartitionIndex(key);
+    if (index < 0)
+        throw rejected(RejectReason::Invalid, runtime_error("Invalid key"));
 
-    streams[index].appendMessage(message);
+    if (operationLimitReached())
+        throw rejected(RejectReason::OperationLimit, runtime_error("Operation limit reached"));
 
-    partitionCount++;
-    operationCount++;
+    lock_guard<mutex> guard(partitionLock(index));
+    return withPartition(index, [&](auto& stream) { return stream.readMessages(startRange, endRange); });
 }
 
-unique_ptr<string[]> PartitionStream::readMessage(const int& key, int startRange, int endRange)
+MessageRange PartitionStream::viewMessage(const int& key, long long startRange, long long endRange)
 {
-    if (!validatePartitionKey(key))
-        throw runtime_error("Invalid key");
+    int index = findPartitionIndex(key);
+    if (index < 0)
+        throw rejected(RejectReason::Invalid, runtime_error("Invalid key"));
 
     if (operationLimitReached())
-        throw runtime_error("Operation limit reached");
+        throw rejected(RejectReason::OperationLimit, runtime_error("Operation limit reached"));
 
+    lock_guard<mutex> guard(partitionLock(index));
+    return withPartition(index, [&](auto& stream) { return stream.viewMessages(startRange, endRange); });
+}
+
+MessageRange PartitionStream::viewMessage(const string& key, long long startRange, long long endRange)
+{
     int index = findPartitionIndex(key);
+    if (index < 0)
+        throw rejected(RejectReason::Invalid, runtime_error("Invalid key"));
+
+    if (operationLimitReached())
+        throw rejected(RejectReason::OperationLimit, runtime_error("Operation limit reached"));
 
-    return streams[index].readMessages(startRange, endRange);
+    lock_guard<mutex> guard(partitionLock(index));
+    return withPartition(index, [&](auto& stream) { return stream.viewMessages(startRange, endRange); });
+}
+
+void PartitionStream::setPartitionKey(int index, int key)
+{
+    if (index < 0 || index >= capacity)
+        throw out_of_range("Invalid index");
+
+    if (key <= 0)
+        throw invalid_argument("Partition keys must be positive.");
+
+    int owner = findPartitionIndex(key);
+    if (owner == index)
+        return;
+
+    if (owner >= 0)
+        throw invalid_argument("Partition key already in use.");
+
+    movedKeys.erase(keys[index]);
+    keys[index] = key;
+    if (key != index + 1)
+    {
+        movedKeys[key] = index;
+    }
 }
 
 int PartitionStream::findPartitionIndex(const int& key) const
 {
-    for (int i = 0; i < capacity; i++)
+    if (key > 0 && key <= capacity && keys[key - 1] == key)
+        return key - 1;
+
+    auto moved = movedKeys.find(key);
+    return moved == movedKeys.end() ? -1 : moved->second;
+}
+
+int PartitionStream::findPartitionIndex(const string& key) const
+{
+    shared_lock<shared_mutex> guard(namedKeysLock);
+    auto named = namedKeys.find(key);
+    return named == namedKeys.end() ? -1 : named->second;
+}
+
+int PartitionStream::claimPartition(const string& key)
+{
+    unique_lock<shared_mutex> guard(namedKeysLock);
+
+    // Another writer may have claimed the key between our lookup and taking the lock.
+    auto named = namedKeys.find(key);
+    if (named != namedKeys.end())
+        return named->second;
+
+    int index = static_cast<int>(namedKeys.size());
+    if (index >= capacity)
+        throw rejected(RejectReason::Full, overflow_error("No space left for a new partition"));
+
+    namedKeys[key] = index;
+    return index;
+}
+
+mutex& PartitionStream::partitionLock(int index) const
+{
+    return partitionLocks[index % lockCount];
+}
+
+void PartitionStream::reserveWrite(string_view message)
+{
+    reserveWrites(1);
+
+    if (!isValidMessage(message))
+    {
+        releaseWrites(1);
+        throw rejected(RejectReason::Invalid, runtime_error("Invalid message"));
+    }
+}
+
+void PartitionStream::reserveWrites(int count)
+{
+    reserveOperations(count);
+
+    if (capacityMode == CapacityMode::Growable)
+    {
+        partitionCount.fetch_add(count, memory_order_relaxed);
+        return;
+    }
+
+    int writes = partitionCount.load(memory_order_relaxed);
+    do
+    {
+        if (writes > capacity - count)
+        {
+            releaseOperations(count);
+            throw rejected(RejectReason::Full, runtime_error("Stream is full"));
+        }
+    } while (!partitionCount.compare_exchange_weak(writes, writes + count, memory_order_relaxed));
+}
+
+void PartitionStream::releaseWrites(int count)
+{
+    releaseOperations(count);
+    partitionCount.fetch_sub(count, memory_order_relaxed);
+}
+
+void PartitionStream::reserveOperations(int count)
+{
+    if (budgetPolicy.kind == BudgetKind::Lifetime)
     {
-        if (keys[i] == key) return i;
+        int operations = operationCount.load(memory_order_relaxed);
+        do
+        {
+            if (operations > budgetPolicy.limit - count)
+                throw rejected(RejectReason::OperationLimit, runtime_error("Operation limit reached"));
+        } while (!operationCount.compare_exchange_weak(operations, operations + count, memory_order_relaxed));
+        return;
     }
-    return -1;
+
+    if (budgetPolicy.kind == BudgetKind::TokenBucket)
+    {
+        lock_guard<mutex> guard(budgetLock);
+        if (!rateBudget.canCharge(count))
+            throw rejected(RejectReason::OperationLimit, runtime_error("Operation limit reached"));
+        rateBudget.charge(count);
+    }
+    operationCount.fetch_add(count, memory_order_relaxed);
+}
+
+void PartitionStream::releaseOperations(int count)
+{
+    if (budgetPolicy.kind == BudgetKind::TokenBucket)
+    {
+        lock_guard<mutex> guard(budgetLock);
+        rateBudget.refund(count);
+    }
+    operationCount.fetch_sub(count, memory_order_relaxed);
+}
+
+void PartitionStream::writeDurablePartitions(IoRing* ring)
+{
+    vector<unique_lock<mutex>> guards;
+    guards.reserve(lockCount);
+    for (int i = 0; i < lockCount; i++)
+    {
+        guards.emplace_back(partitionLocks[i]);
+    }
+
+    if (!ring)
+    {
+        if (!ioRing)
+        {
+            ioRing = unique_ptr<IoRing>(new IoRing());
+        }
+        ring = ioRing.get();
+    }
+
+    for (const unique_ptr<MsgStream>& stream : streams)
+    {
+        DurableStream* durable = dynamic_cast<DurableStream*>(stream.get());
+        if (durable)
+        {
+            durable->queueWrite(*ring);
+        }
+    }
+    ring->submit();
+}
+
+void PartitionStream::appendToPartition(int index, string_view message)
+{
+    lock_guard<mutex> guard(partitionLock(index));
+    try
+    {
+        withPartition(index, [&](auto& stream) { stream.appendMessage(message); });
+    }
+    catch (...)
+    {
+        releaseWrites(1);
+        throw;
+    }
+}
+
+void PartitionStream::trackPartition(int index)
+{
+    inMemory[index] = dynamic_cast<InMemoryStream*>(streams[index].get());
 }
 
-bool PartitionStream::validatePartitionKey(const int& key) const
+void PartitionStream::initializeKeys()
 {
-    return key > 0 && key <= capacity;
+    keys = std::unique_ptr<int[]>(new int[capacity]);
+    lockCount = capacity < MAX_PARTITION_LOCKS ? capacity : MAX_PARTITION_LOCKS;
+    partitionLocks = std::unique_ptr<mutex[]>(new mutex[lockCount]);
+
+    for (int i = 0; i < capacity; i++)
+    {
+        keys[i] = i + 1;
+    }
 }
 
 int PartitionStream::verifyCapacity(int initialCapacity)
 {
-    if (initialCapacity > 200)
+    int maxPartitions = capacityMode == CapacityMode::Growable ? MAX_GROWABLE_PARTITIONS : MAX_PARTITIONS;
+    if (initialCapacity > maxPartitions)
     {
-        return capacity = 200;
+        return capacity = maxPartitions;
     }
     if (initialCapacity <= 0)
     {
@@ -154,15 +551,35 @@ int PartitionStream::verifyCapacity(int initialCapacity)
 
 bool PartitionStream::operationLimitReached()
 {
-    return operationCount >= capacity * 2;
+    if (budgetPolicy.kind == BudgetKind::Lifetime)
+        return operationCount.load(memory_order_relaxed) >= budgetPolicy.limit;
+
+    if (budgetPolicy.kind == BudgetKind::TokenBucket)
+    {
+        lock_guard<mutex> guard(budgetLock);
+        return !rateBudget.canCharge(1);
+    }
+
+    return false;
+}
+
+BudgetPolicy PartitionStream::defaultBudget() const
+{
+    if (capacityMode == CapacityMode::Growable)
+        return BudgetPolicy::unlimited();
+
+    return BudgetPolicy::lifetime(static_cast<long long>(capacity) * 2);
 }
 
 bool PartitionStream::isFull()
 {
-    return partitionCount >= capacity;
+    if (capacityMode == CapacityMode::Growable)
+        return false;
+
+    return partitionCount.load(memory_order_relaxed) >= capacity;
 }
 
-bool PartitionStream::isValidMessage(const string& message) const
+bool PartitionStream::isValidMessage(string_view message) const
 {
     return !message.empty();
 }
@@ -172,6 +589,11 @@ int PartitionStream::getCapacity()
     return capacity;
 }
 
+CapacityMode PartitionStream::getCapacityMode() const
+{
+    return capacityMode;
+}
+
 int PartitionStream::getPartitionCount()
 {
     return partitionCount;
@@ -191,7 +613,16 @@ void PartitionStream::initializeMsgStream(int index, int capacity)
 {
     if (index >= 0 && index < this->capacity)
     {
-        streams[index] = MsgStream(capacity);
+        streams[index] = unique_ptr<MsgStream>(new InMemoryStream(capacity, capacityMode));
+        trackPartition(index);
+        if (hasPartitionBudget)
+        {
+            streams[index]->setOperationBudget(partitionBudget);
+        }
+        if (metrics)
+        {
+            streams[index]->enableMetrics();
+        }
     }
     else
     {
@@ -199,22 +630,140 @@ void PartitionStream::initializeMsgStream(int index, int capacity)
     }
 }
 
+void PartitionStream::setOperationBudget(const BudgetPolicy& policy)
+{
+    budgetPolicy = policy;
+    rateBudget = OperationBudget(policy);
+}
+
+BudgetPolicy PartitionStream::getOperationBudget() const
+{
+    return budgetPolicy;
+}
+
+void PartitionStream::setPartitionBudget(const BudgetPolicy& policy)
+{
+    partitionBudget = policy;
+    hasPartitionBudget = true;
+    for (int i = 0; i < capacity; i++)
+    {
+        streams[i]->setOperationBudget(policy);
+    }
+}
+
+void PartitionStream::setPartitionBudget(int index, const BudgetPolicy& policy)
+{
+    if (index < 0 || index >= capacity)
+        throw out_of_range("Invalid index");
+
+    streams[index]->setOperationBudget(policy);
+}
+
+void PartitionStream::setPartition(int index, unique_ptr<MsgStream> stream)
+{
+    if (index < 0 || index >= capacity)
+        throw out_of_range("Invalid index for partition.");
+
+    if (!stream)
+        throw invalid_argument("Partitions must not be null.");
+
+    if (metrics)
+    {
+        stream->enableMetrics();
+    }
+    streams[index] = move(stream);
+    trackPartition(index);
+}
+
+void PartitionStream::flushDurablePartitions()
+{
+    writeDurablePartitions(nullptr);
+}
+
+void PartitionStream::flushDurablePartitions(IoRing& ring)
+{
+    writeDurablePartitions(&ring);
+}
+
+void PartitionStream::enableMetrics()
+{
+    if (!metrics)
+    {
+        metrics = unique_ptr<StreamMetrics>(new StreamMetrics());
+    }
+    for (const unique_ptr<MsgStream>& stream : streams)
+    {
+        stream->enableMetrics();
+    }
+}
+
+bool PartitionStream::hasMetrics() const
+{
+    return metrics != nullptr;
+}
+
+PartitionMetrics PartitionStream::getMetrics() const
+{
+    PartitionMetrics result = { metrics ? metrics->snapshot() : StreamMetricsSnapshot::empty(), {}, {} };
+    for (int i = 0; i < capacity; i++)
+    {
+        if (streams[i]->hasMetrics())
+        {
+            result.keys.push_back(keys[i]);
+            result.partitions.push_back(streams[i]->getMetrics());
+        }
+    }
+    return result;
+}
+
+StreamMetricsSnapshot PartitionMetrics::total() const
+{
+    StreamMetricsSnapshot sum = stream;
+    for (const StreamMetricsSnapshot& partition : partitions)
+    {
+        sum.merge(partition);
+    }
+    return sum;
+}
+
+string PartitionMetrics::toPrometheus(const string& name) const
+{
+    vector<pair<string, StreamMetricsSnapshot>> series;
+    for (size_t i = 0; i < partitions.size(); i++)
+    {
+        series.emplace_back("partition=\"" + to_string(keys[i]) + "\"", partitions[i]);
+    }
+    return StreamMetrics::toPrometheus(name, { { "", total() } }) + StreamMetrics::toPrometheus(name + "_partition", series);
+}
+
 MsgStream& PartitionStream::operator[](int index) {
     
     if (index < 0 || index >= capacity)
     {
         throw out_of_range("Invalid index");
     }
-    return streams[index];
+    return *streams[index];
 }
 
 void PartitionStream::operator-() {
     
     partitionCount = 0;
     operationCount = 0;
+    rateBudget.reset();
 
-    streams = std::unique_ptr<MsgStream[]>(new MsgStream[capacity]);
+    streams.clear();
+    for (int i = 0; i < capacity; i++)
+    {
+        streams.push_back(unique_ptr<MsgStream>(new InMemoryStream()));
+        trackPartition(i);
+        if (metrics)
+        {
+            streams[i]->enableMetrics();
+        }
+    }
     keys = std::unique_ptr<int[]>(new int[capacity]);
+    movedKeys.clear();
+    namedKeys.clear();
 
     for (int i = 0; i < capacity; i++)
     {
@@ -231,9 +780,9 @@ PartitionStream& PartitionStream::operator+=(const PartitionStream& other) {
 
     for (int i = 0; i < other.capacity; i++)
     {
-        streams[i] += other.streams[i];
+        *streams[i] += *other.streams[i];
     }
-    partitionCount += other.partitionCount;
-    operationCount += other.operationCount;
+    partitionCount += other.partitionCount.load();
+    operationCount += other.operationCount.load();
     return *this;
 }
\ No newline at end of file
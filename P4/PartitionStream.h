@@ -5,30 +5,93 @@
 #define PARTITIONSTREAM_H
 
 #include "MsgStream.h"
+#include "InMemoryStream.h"
+#include "OperationBudget.h"
+#include "IoRing.h"
+#include "StreamMetrics.h"
 #include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <utility>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
 #include <stdexcept>
 
 using namespace std;
 
+// A snapshot of a PartitionStream's metrics: stream holds the operations the PartitionStream refused before they
+// reached a partition (a bad key, the stream-wide budget or partition count), and partitions[i] is the snapshot of
+// the instrumented partition with key keys[i].
+struct PartitionMetrics
+{
+    StreamMetricsSnapshot stream;
+    vector<int> keys;
+    vector<StreamMetricsSnapshot> partitions;
+
+    // Postconditions:
+    // - Returns stream merged with every partition's snapshot.
+    StreamMetricsSnapshot total() const;
+
+    // Postconditions:
+    // - Returns total() as the name series and each partition as a name_partition series labelled with its key, in
+    //   the Prometheus text exposition format.
+    string toPrometheus(const string& name) const;
+};
+
 class PartitionStream
 {
     // Class invariant:
     // - PartitionStream is composed of MsgStream objects, each representing a partitioned sequence of messages.
     // - The capacity must be greater than 0, determining the maximum number of MsgStream partitions available.
+    //   Fixed mode caps it at MAX_PARTITIONS; Growable mode allows up to MAX_GROWABLE_PARTITIONS.
     // - Each MsgStream instance within the PartitionStream is uniquely identified by a partition key.
     // - Dependency injection ensures that the MsgStream objects can be externally provided or replaced, supporting modularity.
+    //   Partitions are held by pointer, so durable, in-memory and other derived streams coexist without slicing and their
+    //   overrides of appendMessage and readMessages are the ones called. Partitions the stream creates itself are
+    //   InMemoryStreams, which writes and reads reach without virtual calls.
     // - The keys array provides a one-to-one mapping of keys to MsgStream instances for efficient partition identification.
+    //   Keys default to 1..capacity but may be reassigned to any unique positive value with setPartitionKey.
+    // - Partitions may also be addressed by string key: the first write with a new string key claims the next unnamed
+    //   partition, as the P2 Partition struct did, and later operations with that key reach the same partition.
     // - The operationCount tracks the number of operations performed across all partitions, ensuring usage limits are respected.
+    //   The stream-wide budget is a lifetime limit of 2 * capacity in Fixed mode and unlimited in Growable mode; either can
+    //   be replaced with setOperationBudget. setPartitionBudget gives each partition its own quota or rate, so one busy
+    //   key cannot use up the throughput of the others.
     // - The partitionCount tracks the number of active partitions with messages, supporting stream management.
     // - PartitionStream operations, such as writing and reading messages, must respect the validity of partition keys and the capacity constraints.
+    // - writeMessage, readMessage, viewMessage and the getters may be called from many threads at once; writes to
+    //   different partitions proceed in parallel. Configuration (setPartitionKey, initializeMsgStream, operator[],
+    //   operator-, operator+=, assignment) must not run concurrently with any other call.
+    // - Views returned by viewMessage must not be read while another thread writes to the same partition.
+    // - getMetrics may be called from any thread at any time; enableMetrics is configuration.
 
     private:
-        unique_ptr<MsgStream[]> streams;
+        vector<unique_ptr<MsgStream>> streams;
+        vector<InMemoryStream*> inMemory;
         unique_ptr<int[]> keys;
+        unordered_map<int, int> movedKeys;
+        unordered_map<string, int> namedKeys;
+        unique_ptr<mutex[]> partitionLocks;
+        mutable shared_mutex namedKeysLock;
+        mutable mutex budgetLock;
         int capacity;
-        int partitionCount;
-        int operationCount;
+        int lockCount;
+        atomic<int> partitionCount;
+        atomic<int> operationCount;
+        CapacityMode capacityMode;
+        BudgetPolicy budgetPolicy;
+        OperationBudget rateBudget;
+        BudgetPolicy partitionBudget;
+        bool hasPartitionBudget;
+        unique_ptr<IoRing> ioRing;
+        unique_ptr<StreamMetrics> metrics;
+
+        static const int MAX_PARTITIONS = 200;
+        static const int MAX_GROWABLE_PARTITIONS = 1 << 20;
+        static const int MAX_PARTITION_LOCKS = 1024;
 
         // Preconditions:
         // - other must be a valid, fully initialized PartitionStream instance.
@@ -58,38 +121,200 @@ class PartitionStream
         //   leaving other in a valid but empty state, and releasing any previously held resources.
         PartitionStream& operator=(PartitionStream&& other) noexcept;
 
+        // Postconditions:
+        // - The refused operation is counted under reason if metrics are enabled, and error is returned to be thrown.
+        template <typename Error>
+        Error rejected(RejectReason reason, const Error& error) const
+        {
+            if (metrics)
+                metrics->recordRejection(reason);
+            return error;
+        }
+
+        // Postconditions:
+        // - Returns operation applied to the partition at index: on its InMemoryStream if it is one, so the calls are
+        //   direct and may be inlined, and through the MsgStream interface otherwise.
+        template <typename Operation>
+        auto withPartition(int index, Operation operation) -> decltype(operation(*streams[index]))
+        {
+            InMemoryStream* stream = inMemory[index];
+            if (stream)
+                return operation(*stream);
+            return operation(*streams[index]);
+        }
+
+        // Postconditions:
+        // - inMemory[index] points at the partition at index if it is an InMemoryStream, and is null otherwise.
+        void trackPartition(int index);
+
         int findPartitionIndex(const int& key) const;
-        bool validatePartitionKey(const int& key) const;
+        int findPartitionIndex(const string& key) const;
+        int claimPartition(const string& key);
+        mutex& partitionLock(int index) const;
+        void reserveWrite(string_view message);
+        void reserveWrites(int count);
+        void releaseWrites(int count);
+        void reserveOperations(int count);
+        void releaseOperations(int count);
+        BudgetPolicy defaultBudget() const;
+        void appendToPartition(int index, string_view message);
+        void writeDurablePartitions(IoRing* ring);
         int verifyCapacity(int initialCapacity);
+        void initializeKeys();
         bool operationLimitReached();
         bool isFull();
-        bool isValidMessage(const string& message) const;
+        bool isValidMessage(string_view message) const;
 
     public:
         // Preconditions:
         // - initial capacity must be between 0 and 200
         // Postconditions:
         // - instance is created with capacity set, initialized streams and associated keys.
+        // - Each array element is moved into its own InMemoryStream partition; elements of a MsgStream array are
+        //   already plain MsgStreams, so inject derived streams with the vector constructor or setPartition instead.
         PartitionStream(int initialCapacity, std::unique_ptr<MsgStream[]> msgStreams);
 
+        // Preconditions:
+        // - initial capacity must be between 0 and MAX_PARTITIONS for Fixed mode, or MAX_GROWABLE_PARTITIONS for Growable mode.
+        // Postconditions:
+        // - instance is created as above; in Growable mode the partition count is not capped by total writes and
+        //   streams created through initializeMsgStream are Growable too, so each partition only enforces its own limits.
+        PartitionStream(int initialCapacity, std::unique_ptr<MsgStream[]> msgStreams, CapacityMode mode);
+
+        // Preconditions:
+        // - partitions must be non-empty with no null entries; its size is the capacity, capped as for the mode.
+        // Postconditions:
+        // - Each stream becomes a partition as-is, keeping its dynamic type, with keys 1..capacity.
+        PartitionStream(vector<unique_ptr<MsgStream>> partitions);
+        PartitionStream(vector<unique_ptr<MsgStream>> partitions, CapacityMode mode);
+
         // Preconditions:
         // - key must be a valid partition key. The operation limit must not be reached, stream must not be full, 
         //   and message must meet validity criteria.
         // Postconditions:
         // - The specified message is appended to the MsgStream associated with the given key, 
         //   partitionCount and operationCount are incremented.
-        void writeMessage(const int& key, const string& message);
+        // - message is passed through as a view, so the only copy is the partition's own store.
+        void writeMessage(const int& key, string_view message);
+
+        // Preconditions:
+        // - key must be non-empty and either already name a partition or an unnamed partition must remain;
+        //   the remaining conditions are as for integer keys.
+        // Postconditions:
+        // - The message is appended to the partition named key, claiming the next unnamed partition for a new key.
+        void writeMessage(const string& key, string_view message);
+
+        // Preconditions:
+        // - key must be a valid partition key and length must be positive; write must fill exactly length bytes.
+        // Postconditions:
+        // - The message is built by write and appended to the partition through MsgStream::emplaceMessage under the
+        //   partition's lock, counted as for writeMessage.
+        template <typename Writer>
+        void emplaceMessage(const int& key, size_t length, Writer write)
+        {
+            int index = findPartitionIndex(key);
+            if (index < 0)
+                throw rejected(RejectReason::Invalid, runtime_error("Invalid key"));
+
+            if (length == 0)
+                throw rejected(RejectReason::Invalid, runtime_error("Invalid message"));
+
+            reserveWrites(1);
+            lock_guard<mutex> guard(partitionLock(index));
+            try
+            {
+                withPartition(index, [&](auto& stream) { stream.emplaceMessage(length, write); });
+            }
+            catch (...)
+            {
+                releaseWrites(1);
+                throw;
+            }
+        }
+
+        // Preconditions:
+        // - batch must point to count (key, message) pairs whose keys are all valid integer partition keys and whose
+        //   messages all meet validity criteria; the operation limit and capacity must cover count writes.
+        // Postconditions:
+        // - Keys and messages are checked and the counters reserved once for the whole batch, then each partition
+        //   receives its messages, in batch order, through a single MsgStream::appendBatch under one lock acquisition.
+        // - If a check fails nothing is written. If a partition rejects its share, partitions already written keep
+        //   their messages, the rest of the batch is not written, and only written messages stay counted.
+        void writeBatch(const pair<int, string>* batch, int count);
+        void writeBatch(const vector<pair<int, string>>& batch);
 
         // Preconditions:
         // - key must be a valid partition key and operation limit must not be reached.
         // Postconditions:
         // - Returns a unique_ptr containing messages from the specified range in the MsgStream associated with the key.
-        unique_ptr<string[]> readMessage(const int& key, int startRange, int endRange);
+        unique_ptr<string[]> readMessage(const int& key, long long startRange, long long endRange);
+        unique_ptr<string[]> readMessage(const string& key, long long startRange, long long endRange);
+
+        // Preconditions:
+        // - key must be a valid partition key and operation limit must not be reached.
+        // Postconditions:
+        // - Returns a non-owning view of [startRange, endRange) in the MsgStream associated with the key,
+        //   valid until that MsgStream's epoch changes.
+        MessageRange viewMessage(const int& key, long long startRange, long long endRange);
+        MessageRange viewMessage(const string& key, long long startRange, long long endRange);
+
+        // Preconditions:
+        // - index must be within [0, capacity) and key must be positive and not used by another partition.
+        // Postconditions:
+        // - The partition at index is addressed by key from now on; its previous key becomes invalid.
+        void setPartitionKey(int index, int key);
         int getCapacity();
+        CapacityMode getCapacityMode() const;
         int getPartitionCount();
         unique_ptr<int[]> getPartitionKeys();
         void initializeMsgStream(int index, int capacity);
 
+        // Preconditions:
+        // - Must not run concurrently with any other call.
+        // Postconditions:
+        // - policy replaces the stream-wide operation budget, with its full allowance available. Writes are charged
+        //   against it and reads are refused once it is exhausted.
+        void setOperationBudget(const BudgetPolicy& policy);
+        BudgetPolicy getOperationBudget() const;
+
+        // Preconditions:
+        // - Must not run concurrently with any other call; index must be within [0, capacity).
+        // Postconditions:
+        // - Every partition (or the partition at index) gets its own budget with policy's full allowance; partitions
+        //   later created by initializeMsgStream get it too. A partition over its budget refuses its own operations
+        //   without affecting the others.
+        void setPartitionBudget(const BudgetPolicy& policy);
+        void setPartitionBudget(int index, const BudgetPolicy& policy);
+
+        // Preconditions:
+        // - Must not run concurrently with configuration calls.
+        // Postconditions:
+        // - The records buffered by every DurableStream partition are written through one shared IoRing (created on
+        //   first use, or ring if given), so all partitions together cost one io_uring_enter per ring-full of writes
+        //   instead of a write call each. Partitions whose policy syncs are fdatasynced after their write.
+        // - Every partition is locked until the writes complete, so concurrent writes wait for the flush.
+        void flushDurablePartitions();
+        void flushDurablePartitions(IoRing& ring);
+
+        // Preconditions:
+        // - Must not run concurrently with any other call.
+        // Postconditions:
+        // - Every partition enables its MsgStream metrics (about 9 KB each), and so do partitions later set or
+        //   created; the PartitionStream also counts the operations it refuses itself.
+        void enableMetrics();
+        bool hasMetrics() const;
+
+        // Postconditions:
+        // - Returns the refusals counted by the PartitionStream and a snapshot of every instrumented partition. Each
+        //   snapshot is read without locks, so the partitions are not captured at one instant.
+        PartitionMetrics getMetrics() const;
+
+        // Preconditions:
+        // - index must be within [0, capacity) and stream must not be null.
+        // Postconditions:
+        // - stream replaces the partition at index, keeping its dynamic type; the previous stream is destroyed.
+        void setPartition(int index, unique_ptr<MsgStream> stream);
+
         // Preconditions:
         // - index must be within the range [0, capacity)
         // Postconditions:
@@ -112,12 +337,38 @@ class PartitionStream
 // - PartitionStream relies on MsgStream for core message management in each partition.
 // - Dependency injection allows externally provided MsgStream objects to replace or initialize partitions at construction.
 // - The keys array ensures a unique mapping between partition keys and their respective MsgStream instances.
-// - The findPartitionIndex function guarantees efficient key lookups for partition operations.
-// - The validatePartitionKey function ensures all operations are performed on valid keys within the partition range.
-// - The verifyCapacity function enforces that the capacity is capped at 200 and defaults to 1 if the initial value is invalid.
+// - findPartitionIndex is O(1): a key k that still sits at its default position is checked directly at keys[k - 1],
+//   and any other integer key is looked up in movedKeys. String keys are looked up in namedKeys. An unknown key
+//   yields -1 and the operation throws "Invalid key".
+// - movedKeys holds exactly the keys that differ from their default (index + 1); namedKeys.size() partitions
+//   (indices [0, namedKeys.size())) have been claimed by string keys.
+// - The verifyCapacity function enforces that the capacity is capped at MAX_PARTITIONS (MAX_GROWABLE_PARTITIONS in
+//   Growable mode) and defaults to 1 if the initial value is invalid.
 // - Unique ownership of MsgStream objects is managed through std::unique_ptr to ensure safe and automatic memory management.
+//   streams holds exactly capacity non-null pointers; copies use MsgStream::clone so each copy keeps its dynamic type.
+// - inMemory parallels streams and is updated (by trackPartition) wherever a partition is replaced. Writes, reads and
+//   views go through withPartition, so an InMemoryStream partition is called by its final type and its checks and
+//   storage inline into PartitionStream; only other derived streams, such as DurableStream, pay for virtual calls.
 // - Copy and move semantics for PartitionStream ensure proper resource management and prevent unintended aliasing.
 // - Operation limits (operationLimitReached) and capacity constraints (isFull) are enforced to maintain predictable behavior.
+//   In Growable mode the partition count is left to the individual partitions and the default budget is unlimited.
+// - A Lifetime stream-wide budget is enforced on the atomic operationCount with compare-and-swap and an Unlimited one
+//   with a plain fetch_add, so neither takes a lock. Only a TokenBucket budget, whose refill reads the clock and
+//   updates two fields together, is guarded by budgetLock.
+// - partitionCount and operationCount are atomics. A write reserves its share of both with a compare-and-swap against
+//   the limits before appending, and gives the reservation back if the append fails, so concurrent writers can never
+//   overshoot a limit or count a failed write.
+// - writeBatch reserves all of its writes with one compare-and-swap per counter and holds at most one partition lock
+//   at a time, so batches cannot deadlock with each other or with single writes.
+// - Each partition's MsgStream is guarded by partitionLocks[index % lockCount]; at most MAX_PARTITION_LOCKS mutexes
+//   are striped across the partitions, so memory for locks stays bounded while unrelated partitions rarely contend.
+// - flushDurablePartitions takes every partition lock in index order, the order no other path holds two of them in,
+//   so it cannot deadlock with writers. ioRing is used only while all of them are held.
+// - Per-partition counters live in each partition's StreamMetrics and are updated under that partition's lock, so
+//   instrumenting a busy PartitionStream adds no shared cache line between partitions. metrics itself only counts
+//   refusals, which are rare, so its counters stay uncontended too.
+// - Integer key lookups read only keys and movedKeys, which change only during configuration, so they take no lock.
+//   namedKeys can grow during writes and is guarded by namedKeysLock: shared for lookups, exclusive for claims.
 // - MsgStream initialization and dependency injection must maintain integrity, avoiding invalid or uninitialized MsgStream objects.
 // - overloaded operator[] helps simplify access to MsgStream objects by index which improves abstraction.
 // - overloaded operator- provided a simple way to reset the state of PartitionStream without calling a separate function.
@@ -0,0 +1,112 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#ifndef PUBLISHEDDIRECTORY_H
+#define PUBLISHEDDIRECTORY_H
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+using namespace std;
+
+template <typename T>
+class PublishedDirectory
+{
+    // Class invariant:
+    // - PublishedDirectory is an append-only array of small values (pointers) written by one thread and readable by
+    //   any number of threads at the same time without locks.
+    // - An entry, once written, never moves and never changes, so a reader that learned about entry i through a
+    //   release/acquire pair (such as a published message count) can always read it.
+    // - Growing never frees the previous array; it is retired and kept until the directory is destroyed, so readers
+    //   still holding it stay safe.
+
+    public:
+        // Postconditions:
+        // - Creates an empty directory that owns no memory.
+        PublishedDirectory() : entries(nullptr), count(0), allocated(0) {}
+
+        PublishedDirectory(const PublishedDirectory& other) = delete;
+        PublishedDirectory& operator=(const PublishedDirectory& other) = delete;
+
+        // Postconditions:
+        // - Entries are transferred from other, which is left empty. Must not race with readers of either directory.
+        PublishedDirectory(PublishedDirectory&& other) noexcept
+            : generations(move(other.generations)), entries(other.entries.load(memory_order_relaxed)),
+              count(other.count), allocated(other.allocated)
+        {
+            other.generations.clear();
+            other.entries.store(nullptr, memory_order_relaxed);
+            other.count = 0;
+            other.allocated = 0;
+        }
+
+        PublishedDirectory& operator=(PublishedDirectory&& other) noexcept
+        {
+            if (this == &other) return *this;
+
+            generations = move(other.generations);
+            entries.store(other.entries.load(memory_order_relaxed), memory_order_relaxed);
+            count = other.count;
+            allocated = other.allocated;
+
+            other.generations.clear();
+            other.entries.store(nullptr, memory_order_relaxed);
+            other.count = 0;
+            other.allocated = 0;
+
+            return *this;
+        }
+
+        // Preconditions:
+        // - Called only by the writing thread.
+        // Postconditions:
+        // - value is stored at index size() - 1; readers see it once the caller publishes it.
+        void push(T value)
+        {
+            if (count == allocated)
+            {
+                grow();
+            }
+            generations.back()[count++] = value;
+        }
+
+        // Preconditions:
+        // - index must be within [0, size()) as published to the calling thread.
+        T operator[](int index) const
+        {
+            return entries.load(memory_order_acquire)[index];
+        }
+
+        int size() const { return count; }
+
+    private:
+        static const int FIRST_SIZE = 8;
+
+        vector<unique_ptr<T[]>> generations;
+        atomic<T*> entries;
+        int count;
+        int allocated;
+
+        void grow()
+        {
+            int size = allocated == 0 ? FIRST_SIZE : allocated * 2;
+            unique_ptr<T[]> next(new T[size]);
+            if (count > 0)
+            {
+                copy(generations.back().get(), generations.back().get() + count, next.get());
+            }
+
+            generations.push_back(move(next));
+            entries.store(generations.back().get(), memory_order_release);
+            allocated = size;
+        }
+};
+
+// Implementation invariant:
+// - generations.back() is the live array and entries always points at it; earlier generations are retired copies.
+// - Retired generations add up to less than the live one, so the directory never costs more than twice its entries.
+// - Only count and generations.back() are written after construction, and only by the writer.
+
+#endif
@@ -0,0 +1,56 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#ifndef RETENTIONPOLICY_H
+#define RETENTIONPOLICY_H
+
+#include <cstddef>
+#include <stdexcept>
+
+using namespace std;
+
+struct RetentionPolicy
+{
+    // Class invariant:
+    // - RetentionPolicy decides what a MsgStream does when an append would exceed its limits.
+    // - With evictOldest unset, appends to a full stream are rejected (the original behaviour).
+    // - With evictOldest set, the stream behaves as a ring buffer: the oldest messages are evicted to make room,
+    //   so it retains at most capacity messages and, if maxBytes is non-zero, at most maxBytes message bytes.
+    // - Messages keep their logical offset for life; offsets of retained messages run from getFirstOffset()
+    //   to getNextOffset() and only ever increase until the stream is reset.
+
+    bool evictOldest;
+    size_t maxBytes;
+
+    // Postconditions:
+    // - Returns the original MsgStream behaviour: appends fail once capacity messages are stored.
+    static RetentionPolicy rejectWhenFull()
+    {
+        return RetentionPolicy{ false, 0 };
+    }
+
+    // Postconditions:
+    // - Returns a policy that keeps the most recent capacity messages.
+    static RetentionPolicy keepLatest()
+    {
+        return RetentionPolicy{ true, 0 };
+    }
+
+    // Preconditions:
+    // - bytes must be greater than 0.
+    // Postconditions:
+    // - Returns a policy that keeps the most recent messages whose bytes add up to at most bytes
+    //   (and never more than capacity messages).
+    static RetentionPolicy keepLatestBytes(size_t bytes)
+    {
+        if (bytes == 0)
+            throw invalid_argument("Retained byte limit must be positive.");
+        return RetentionPolicy{ true, bytes };
+    }
+};
+
+// Implementation invariant:
+// - maxBytes of 0 means the byte count is unbounded; the message count is always bounded by capacity.
+// - Policies are plain values so each partition can be configured independently.
+
+#endif
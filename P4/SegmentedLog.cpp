@@ -0,0 +1,1047 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#include "SegmentedLog.h"
+#include "IoRing.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+namespace
+{
+    const long long READ_BLOCK = 64 * 1024;
+
+    void writeAll(int fd, const char* data, size_t length)
+    {
+        while (length > 0)
+        {
+            ssize_t written = ::write(fd, data, length);
+            if (written < 0)
+                throw runtime_error("Failed to write to log segment.");
+            data += written;
+            length -= written;
+        }
+    }
+
+    string readBytes(int fd, long long position, long long length)
+    {
+        string bytes(length, '\0');
+        long long total = 0;
+        while (total < length)
+        {
+            ssize_t count = ::pread(fd, &bytes[total], length - total, position + total);
+            if (count < 0)
+                throw runtime_error("Failed to read from log segment.");
+            if (count == 0)
+                break;
+            total += count;
+        }
+        bytes.resize(total);
+        return bytes;
+    }
+
+    void putUint32(string& buffer, uint32_t value)
+    {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    uint32_t getUint32(const char* data)
+    {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    void putInt64(string& buffer, long long value)
+    {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    long long getInt64(const char* data)
+    {
+        long long value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+}
+
+SegmentedLog::SegmentedLog(const string& basePath, long long segmentSize)
+    : basePath(basePath), segmentSize(segmentSize), messageCount(0), flushedCount(0),
+      activeFd(-1), activeIndexFd(-1), activeInode(0), syncOnFlush(false),
+      readFd(-1), readSegment(-1), recovery(), snapshotSegments(0), created(false)
+{
+    if (basePath.empty())
+        throw invalid_argument("Invalid log path.");
+
+    if (segmentSize <= HEADER_SIZE || segmentSize > UINT32_MAX)
+        throw invalid_argument("Invalid segment size.");
+
+    loadSegments(true);
+    openActiveSegment();
+}
+
+SegmentedLog::~SegmentedLog()
+{
+    try
+    {
+        writeSnapshot();
+    }
+    catch (const exception&)
+    {
+        // Destructors must not throw; records still buffered here are lost like any unflushed write.
+    }
+    closeFiles();
+    unmapSegments();
+}
+
+void SegmentedLog::append(string_view message)
+{
+    if (message.size() > MAX_RECORD_SIZE)
+        throw invalid_argument("Record exceeds maximum size.");
+
+    long long recordSize = HEADER_SIZE + message.size();
+    if (segments.back().size > 0 && segments.back().size + recordSize > segmentSize)
+    {
+        rollSegment();
+    }
+
+    Segment& active = segments.back();
+    long long relative = messageCount - active.firstMessage;
+    if (relative % INDEX_INTERVAL == 0)
+    {
+        IndexEntry entry = { static_cast<uint32_t>(relative), static_cast<uint32_t>(active.size) };
+        active.index.push_back(entry);
+        putUint32(indexBuffer, entry.relativeMessage);
+        putUint32(indexBuffer, entry.position);
+    }
+
+    putUint32(writeBuffer, static_cast<uint32_t>(message.size()));
+    putUint32(writeBuffer, crc32(message.data(), message.size()));
+    writeBuffer.append(message);
+
+    active.size += recordSize;
+    active.messageCount++;
+    messageCount++;
+}
+
+void SegmentedLog::flush()
+{
+    if (!writeBuffer.empty())
+    {
+        writeAll(activeFd, writeBuffer.data(), writeBuffer.size());
+        writeBuffer.clear();
+    }
+    // Records a failed queueFlush wrote but did not sync are past flushedCount with nothing left to write.
+    if (syncOnFlush && flushedCount < messageCount && ::fdatasync(activeFd) != 0)
+        throw runtime_error("Failed to sync log segment.");
+    if (!indexBuffer.empty())
+    {
+        writeAll(activeIndexFd, indexBuffer.data(), indexBuffer.size());
+        indexBuffer.clear();
+    }
+    flushedCount = messageCount;
+}
+
+void SegmentedLog::queueFlush(IoRing& ring)
+{
+    // Both files are open with O_APPEND, so the buffers are queued as appends, like flush's writes.
+    long long queuedCount = messageCount;
+    if (!writeBuffer.empty())
+    {
+        ring.queueWrite(activeFd, writeBuffer, syncOnFlush, [this, queuedCount](bool completed, string& unwritten)
+        {
+            if (completed)
+            {
+                flushedCount = max(flushedCount, queuedCount);
+                return;
+            }
+            writeBuffer.insert(0, unwritten);
+        });
+    }
+    else if (flushedCount < queuedCount)
+    {
+        // Left written but unsynced by an earlier failed submit; there is nothing to queue but the sync.
+        if (syncOnFlush && ::fdatasync(activeFd) != 0)
+            throw runtime_error("Failed to sync log segment.");
+        flushedCount = queuedCount;
+    }
+    if (!indexBuffer.empty())
+    {
+        ring.queueWrite(activeIndexFd, indexBuffer, false, [this](bool completed, string& unwritten)
+        {
+            if (!completed)
+                indexBuffer.insert(0, unwritten);
+        });
+    }
+}
+
+void SegmentedLog::setSyncOnFlush(bool sync)
+{
+    syncOnFlush = sync;
+}
+
+string SegmentedLog::read(long long messageNumber)
+{
+    return move(readRange(messageNumber, messageNumber + 1)[0]);
+}
+
+unique_ptr<string[]> SegmentedLog::readRange(long long startRange, long long endRange)
+{
+    if (startRange < 0 || endRange < startRange || endRange > messageCount)
+        throw out_of_range("Invalid range for reading log.");
+
+    if (endRange > flushedCount)
+        flush();
+
+    unique_ptr<string[]> result(new string[endRange - startRange]);
+    long long next = startRange;
+
+    while (next < endRange)
+    {
+        int segmentIndex = findSegment(next);
+        ensureIndex(segments[segmentIndex]);
+        const Segment& segment = segments[segmentIndex];
+        int fd = openForRead(segmentIndex);
+
+        long long relative = next - segment.firstMessage;
+        auto entry = upper_bound(segment.index.begin(), segment.index.end(), relative,
+            [](long long value, const IndexEntry& indexEntry) { return value < indexEntry.relativeMessage; });
+        --entry;
+
+        long long current = entry->relativeMessage;
+        long long position = entry->position;
+        long long last = min(endRange, segment.firstMessage + segment.messageCount) - segment.firstMessage;
+
+        string block;
+        long long blockStart = position;
+
+        while (current < last)
+        {
+            if (position + HEADER_SIZE > blockStart + static_cast<long long>(block.size()))
+            {
+                blockStart = position;
+                block = readBytes(fd, blockStart, READ_BLOCK);
+            }
+            if (position + HEADER_SIZE > blockStart + static_cast<long long>(block.size()))
+                throw runtime_error("Truncated record in log.");
+
+            uint32_t length = getUint32(&block[position - blockStart]);
+            uint32_t checksum = getUint32(&block[position - blockStart + 4]);
+            long long recordEnd = position + HEADER_SIZE + length;
+
+            if (current >= relative)
+            {
+                if (recordEnd > blockStart + static_cast<long long>(block.size()))
+                {
+                    blockStart = position;
+                    block = readBytes(fd, blockStart, max<long long>(READ_BLOCK, HEADER_SIZE + length));
+                    if (recordEnd > blockStart + static_cast<long long>(block.size()))
+                        throw runtime_error("Truncated record in log.");
+                }
+
+                const char* payload = &block[position - blockStart + HEADER_SIZE];
+                if (crc32(payload, length) != checksum)
+                    throw runtime_error("Checksum mismatch in log.");
+
+                result[segment.firstMessage + current - startRange].assign(payload, length);
+                next++;
+            }
+
+            position = recordEnd;
+            current++;
+        }
+    }
+
+    return result;
+}
+
+vector<string_view> SegmentedLog::viewRange(long long startRange, long long endRange)
+{
+    if (startRange < 0 || endRange < startRange || endRange > messageCount)
+        throw out_of_range("Invalid range for reading log.");
+
+    if (endRange > flushedCount)
+        flush();
+
+    vector<string_view> result;
+    result.reserve(endRange - startRange);
+    long long next = startRange;
+
+    while (next < endRange)
+    {
+        int segmentIndex = findSegment(next);
+        ensureIndex(segments[segmentIndex]);
+        const char* data = mapSegment(segmentIndex);
+        const Segment& segment = segments[segmentIndex];
+
+        long long relative = next - segment.firstMessage;
+        auto entry = upper_bound(segment.index.begin(), segment.index.end(), relative,
+            [](long long value, const IndexEntry& indexEntry) { return value < indexEntry.relativeMessage; });
+        --entry;
+
+        long long current = entry->relativeMessage;
+        long long position = entry->position;
+        long long last = min(endRange, segment.firstMessage + segment.messageCount) - segment.firstMessage;
+
+        while (current < last)
+        {
+            uint32_t length = getUint32(data + position);
+
+            if (current >= relative)
+            {
+                if (position + HEADER_SIZE + length > segment.size)
+                    throw runtime_error("Truncated record in log.");
+
+                const char* payload = data + position + HEADER_SIZE;
+                if (crc32(payload, length) != getUint32(data + position + 4))
+                    throw runtime_error("Checksum mismatch in log.");
+
+                result.emplace_back(payload, length);
+                next++;
+            }
+
+            position += HEADER_SIZE + length;
+            current++;
+        }
+    }
+
+    return result;
+}
+
+bool SegmentedLog::refresh()
+{
+    // The file holds everything but the buffered bytes until another writer touches it, and then nothing needs writing.
+    struct stat status;
+    Segment& active = segments.back();
+    long long flushedSize = active.size - static_cast<long long>(writeBuffer.size());
+    if (::stat(segmentPath(active.firstMessage, ".log").c_str(), &status) == 0 && status.st_ino == activeInode
+        && status.st_size == flushedSize && ::access(segmentPath(messageCount, ".log").c_str(), F_OK) != 0)
+    {
+        return false;
+    }
+
+    flush();
+
+    if (::stat(segmentPath(active.firstMessage, ".log").c_str(), &status) != 0
+        || status.st_ino != activeInode || status.st_size < active.size)
+    {
+        reload();
+        return true;
+    }
+
+    if (status.st_size == active.size && ::access(segmentPath(messageCount, ".log").c_str(), F_OK) != 0)
+    {
+        return false;
+    }
+
+    // Other writers may have filled the active segment and rolled on to new ones named by their first message.
+    long long previousCount = active.messageCount;
+    scanTail(active);
+    messageCount += active.messageCount - previousCount;
+
+    bool rolled = false;
+    while (::access(segmentPath(messageCount, ".log").c_str(), F_OK) == 0)
+    {
+        Segment segment = { messageCount, 0, 0, {}, false, nullptr, 0 };
+        scanSegment(segment);
+        segments.push_back(move(segment));
+        messageCount += segments.back().messageCount;
+        rolled = true;
+
+        if (segments.back().messageCount == 0)
+            break;
+    }
+    flushedCount = messageCount;
+
+    if (rolled)
+    {
+        closeFiles();
+        openActiveSegment();
+    }
+
+    return false;
+}
+
+void SegmentedLog::clear()
+{
+    writeBuffer.clear();
+    indexBuffer.clear();
+    closeFiles();
+    unmapSegments();
+
+    for (const Segment& segment : segments)
+    {
+        ::unlink(segmentPath(segment.firstMessage, ".log").c_str());
+        ::unlink(segmentPath(segment.firstMessage, ".idx").c_str());
+    }
+    ::unlink((basePath + ".snapshot").c_str());
+
+    reload();
+}
+
+void SegmentedLog::truncate(long long count)
+{
+    if (count < 0 || count > messageCount)
+        throw out_of_range("Invalid message count for truncating log.");
+
+    flush();
+    closeFiles();
+    unmapSegments();
+    ::unlink((basePath + ".snapshot").c_str());
+    snapshotSegments = 0;
+
+    // Later segments go first, newest to oldest, so a crash part way still leaves a valid prefix of the log.
+    size_t keep = findSegment(count) + 1;
+    while (segments.size() > keep)
+    {
+        ::unlink(segmentPath(segments.back().firstMessage, ".log").c_str());
+        ::unlink(segmentPath(segments.back().firstMessage, ".idx").c_str());
+        segments.pop_back();
+    }
+
+    Segment& active = segments.back();
+    ensureIndex(active);
+    long long relative = count - active.firstMessage;
+
+    if (relative < active.messageCount)
+    {
+        auto entry = upper_bound(active.index.begin(), active.index.end(), relative,
+            [](long long value, const IndexEntry& indexEntry) { return value < indexEntry.relativeMessage; });
+        --entry;
+
+        // At most INDEX_INTERVAL - 1 record headers separate the index entry from the cut.
+        string path = segmentPath(active.firstMessage, ".log");
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw runtime_error("Failed to open log segment for truncating.");
+
+        long long position = entry->position;
+        for (long long current = entry->relativeMessage; current < relative; current++)
+        {
+            string header = readBytes(fd, position, HEADER_SIZE);
+            if (static_cast<long long>(header.size()) < HEADER_SIZE)
+            {
+                ::close(fd);
+                throw runtime_error("Truncated record in log.");
+            }
+            position += HEADER_SIZE + getUint32(&header[0]);
+        }
+
+        // The kept records are copied to a new file renamed over the segment rather than cut in place. The new inode
+        // makes every other handle's refresh reload, even after appends grow the segment past the size it last saw.
+        string temporary = path + ".tmp";
+        int output = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (output < 0)
+        {
+            ::close(fd);
+            throw runtime_error("Failed to open log segment for truncating.");
+        }
+        try
+        {
+            for (long long copied = 0; copied < position;)
+            {
+                string block = readBytes(fd, copied, min(READ_BLOCK, position - copied));
+                if (block.empty())
+                    throw runtime_error("Truncated record in log.");
+                writeAll(output, block.data(), block.size());
+                copied += static_cast<long long>(block.size());
+            }
+            if (syncOnFlush && ::fdatasync(output) != 0)
+                throw runtime_error("Failed to sync log segment.");
+        }
+        catch (...)
+        {
+            ::close(fd);
+            ::close(output);
+            ::unlink(temporary.c_str());
+            throw;
+        }
+        ::close(fd);
+        ::close(output);
+
+        if (::rename(temporary.c_str(), path.c_str()) != 0)
+            throw runtime_error("Failed to truncate log segment.");
+
+        active.index.erase(entry + (entry->relativeMessage < relative ? 1 : 0), active.index.end());
+        active.messageCount = relative;
+        active.size = position;
+    }
+
+    messageCount = count;
+    flushedCount = count;
+    openActiveSegment();
+}
+
+long long SegmentedLog::getMessageCount() const
+{
+    return messageCount;
+}
+
+long long SegmentedLog::getSegmentCount() const
+{
+    return segments.size();
+}
+
+RecoveryReport SegmentedLog::getRecoveryReport() const
+{
+    return recovery;
+}
+
+bool SegmentedLog::wasCreated() const
+{
+    return created;
+}
+
+uint32_t SegmentedLog::crc32(const char* data, size_t length)
+{
+    static const unique_ptr<uint32_t[]> table = []()
+    {
+        unique_ptr<uint32_t[]> entries(new uint32_t[256]);
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                value = (value & 1) ? (0xEDB88320u ^ (value >> 1)) : (value >> 1);
+            }
+            entries[i] = value;
+        }
+        return entries;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+string SegmentedLog::segmentPath(long long firstMessage, const string& extension) const
+{
+    char number[32];
+    snprintf(number, sizeof(number), "%020lld", firstMessage);
+    return basePath + "." + number + extension;
+}
+
+void SegmentedLog::loadSegments(bool repair)
+{
+    namespace fs = std::filesystem;
+
+    auto start = chrono::steady_clock::now();
+    recovery = RecoveryReport();
+
+    fs::path base(basePath);
+    fs::path directory = base.has_parent_path() ? base.parent_path() : fs::path(".");
+    string prefix = base.filename().string() + ".";
+
+    vector<long long> firstMessages;
+    error_code error;
+    for (const auto& entry : fs::directory_iterator(directory, error))
+    {
+        string name = entry.path().filename().string();
+        if (name.size() != prefix.size() + 20 + 4 || name.compare(0, prefix.size(), prefix) != 0
+            || name.compare(name.size() - 4, 4, ".log") != 0)
+        {
+            continue;
+        }
+
+        string number = name.substr(prefix.size(), 20);
+        if (all_of(number.begin(), number.end(), [](char c) { return c >= '0' && c <= '9'; }))
+        {
+            firstMessages.push_back(stoll(number));
+        }
+    }
+    sort(firstMessages.begin(), firstMessages.end());
+
+    if (firstMessages.empty())
+    {
+        // Only the constructor repairs, so this records that the log did not exist when it was opened.
+        if (repair)
+            created = true;
+        firstMessages.push_back(0);
+    }
+
+    for (size_t i = loadSnapshot(firstMessages, repair); i < firstMessages.size(); i++)
+    {
+        Segment segment = { firstMessages[i], 0, 0, {}, false, nullptr, 0 };
+        recovery.segmentsLoaded++;
+
+        if (i + 1 == firstMessages.size())
+        {
+            scanSegment(segment);
+            recovery.recordsScanned += segment.messageCount;
+            if (repair)
+            {
+                truncateTail(segment);
+            }
+            segments.push_back(move(segment));
+            break;
+        }
+
+        long long expectedCount = firstMessages[i + 1] - firstMessages[i];
+        if (verifySealedSegment(segment, expectedCount))
+        {
+            segments.push_back(move(segment));
+            continue;
+        }
+
+        // The tail did not check out, so the whole segment is scanned to find where its valid records end.
+        scanSegment(segment);
+        recovery.recordsScanned += segment.messageCount;
+        if (segment.messageCount >= expectedCount)
+        {
+            segment.messageCount = expectedCount;
+            segments.push_back(move(segment));
+            continue;
+        }
+
+        // A torn sealed segment ends the log: later segments would leave a gap in the message numbering.
+        recovery.segmentsDiscarded = firstMessages.size() - i - 1;
+        if (repair)
+        {
+            truncateTail(segment);
+            for (size_t later = i + 1; later < firstMessages.size(); later++)
+            {
+                ::unlink(segmentPath(firstMessages[later], ".log").c_str());
+                ::unlink(segmentPath(firstMessages[later], ".idx").c_str());
+            }
+        }
+        segments.push_back(move(segment));
+        break;
+    }
+
+    messageCount = segments.back().firstMessage + segments.back().messageCount;
+    flushedCount = messageCount;
+    recovery.microseconds = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+}
+
+size_t SegmentedLog::loadSnapshot(const vector<long long>& firstMessages, bool repair)
+{
+    snapshotSegments = 0;
+
+    int fd = ::open((basePath + ".snapshot").c_str(), O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat status;
+    string bytes = ::fstat(fd, &status) == 0 ? readBytes(fd, 0, status.st_size) : string();
+    ::close(fd);
+
+    const size_t header = 16;
+    const size_t entrySize = 32;
+    if (bytes.size() < header + 4 || getUint32(&bytes[0]) != SNAPSHOT_MAGIC
+        || crc32(bytes.data(), bytes.size() - 4) != getUint32(&bytes[bytes.size() - 4]))
+    {
+        return 0;
+    }
+
+    long long count = getInt64(&bytes[8]);
+    if (count <= 0 || count > static_cast<long long>(firstMessages.size()) || bytes.size() != header + count * entrySize + 4)
+        return 0;
+
+    // The last entry is the segment that was active when the snapshot was written. If it has been sealed since, only
+    // the entries before it are used and the loop in loadSegments checks the rest.
+    bool activeRecorded = count == static_cast<long long>(firstMessages.size());
+    if (!activeRecorded && --count == 0)
+        return 0;
+
+    vector<Segment> restored;
+    vector<unsigned long long> inodes;
+    for (long long i = 0; i < count; i++)
+    {
+        const char* entry = &bytes[header + i * entrySize];
+        Segment segment = { getInt64(entry), getInt64(entry + 8), getInt64(entry + 16), {}, false, nullptr, 0 };
+        bool sealed = i + 1 < static_cast<long long>(firstMessages.size());
+        if (segment.firstMessage != firstMessages[i]
+            || (sealed && segment.firstMessage + segment.messageCount != firstMessages[i + 1]))
+        {
+            return 0;
+        }
+        restored.push_back(move(segment));
+        inodes.push_back(static_cast<unsigned long long>(getInt64(entry + 24)));
+    }
+
+    // Sealed segments never change, so checking the last one is enough to tell the snapshot from a stale one. The
+    // active segment may only have grown since.
+    for (long long i = activeRecorded ? max(count - 2, 0LL) : count - 1; i < count; i++)
+    {
+        bool grows = activeRecorded && i == count - 1;
+        if (::stat(segmentPath(restored[i].firstMessage, ".log").c_str(), &status) != 0 || status.st_ino != inodes[i]
+            || (grows ? status.st_size < restored[i].size : status.st_size != restored[i].size))
+        {
+            return 0;
+        }
+    }
+
+    if (activeRecorded)
+    {
+        // Only the records appended after the snapshot are replayed; the index covers the snapshotted prefix.
+        Segment& active = restored.back();
+        long long snapshotCount = active.messageCount;
+        loadIndex(active);
+        if (active.messageCount > 0 && active.index.empty())
+            return 0;
+
+        active.indexLoaded = true;
+        scanTail(active);
+        recovery.recordsScanned += active.messageCount - snapshotCount;
+        if (repair)
+        {
+            truncateTail(active);
+        }
+    }
+
+    for (Segment& segment : restored)
+    {
+        segments.push_back(move(segment));
+    }
+    snapshotSegments = activeRecorded ? count - 1 : count;
+    recovery.segmentsLoaded += count;
+    recovery.segmentsFromSnapshot = count;
+    return count;
+}
+
+void SegmentedLog::writeSnapshot()
+{
+    flush();
+
+    string bytes;
+    putUint32(bytes, SNAPSHOT_MAGIC);
+    putUint32(bytes, 1);
+    putInt64(bytes, static_cast<long long>(segments.size()));
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        // Only the last two entries are ever checked against the files, so only they record an inode.
+        const Segment& segment = segments[i];
+        unsigned long long inode = 0;
+        struct stat status;
+        if (i + 2 >= segments.size())
+        {
+            if (::stat(segmentPath(segment.firstMessage, ".log").c_str(), &status) != 0)
+                throw runtime_error("Failed to stat log segment for snapshot.");
+            inode = status.st_ino;
+        }
+
+        putInt64(bytes, segment.firstMessage);
+        putInt64(bytes, segment.messageCount);
+        putInt64(bytes, segment.size);
+        putInt64(bytes, static_cast<long long>(inode));
+    }
+    putUint32(bytes, crc32(bytes.data(), bytes.size()));
+
+    // Written beside the live snapshot and renamed over it, so a crash leaves either the old or the new one.
+    string temporary = basePath + ".snapshot.tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw runtime_error("Failed to open log snapshot for writing.");
+    writeAll(fd, bytes.data(), bytes.size());
+    if (syncOnFlush && ::fdatasync(fd) != 0)
+    {
+        ::close(fd);
+        throw runtime_error("Failed to sync log snapshot.");
+    }
+    ::close(fd);
+
+    if (::rename(temporary.c_str(), (basePath + ".snapshot").c_str()) != 0)
+        throw runtime_error("Failed to replace log snapshot.");
+    snapshotSegments = static_cast<long long>(segments.size()) - 1;
+}
+
+bool SegmentedLog::verifySealedSegment(Segment& segment, long long expectedCount)
+{
+    namespace fs = std::filesystem;
+
+    error_code error;
+    long long fileSize = fs::file_size(segmentPath(segment.firstMessage, ".log"), error);
+    if (error)
+        return false;
+
+    long long indexSize = fs::file_size(segmentPath(segment.firstMessage, ".idx"), error);
+    if (error || indexSize < 8)
+        return false;
+
+    int fd = ::open(segmentPath(segment.firstMessage, ".idx").c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    string bytes = readBytes(fd, indexSize / 8 * 8 - 8, 8);
+    ::close(fd);
+    if (bytes.size() < 8)
+        return false;
+
+    IndexEntry last = { getUint32(&bytes[0]), getUint32(&bytes[4]) };
+    if (last.relativeMessage >= expectedCount || last.relativeMessage % INDEX_INTERVAL != 0 || last.position >= fileSize)
+        return false;
+
+    // Only the records after the last index entry are checked, so the cost per segment is at most INDEX_INTERVAL records.
+    Segment tail = { segment.firstMessage, last.relativeMessage, last.position, {}, false, nullptr, 0 };
+    scanTail(tail);
+    recovery.recordsScanned += tail.messageCount - last.relativeMessage;
+    if (tail.messageCount < expectedCount)
+        return false;
+
+    segment.messageCount = expectedCount;
+    segment.size = fileSize;
+    return true;
+}
+
+void SegmentedLog::truncateTail(const Segment& segment)
+{
+    string path = segmentPath(segment.firstMessage, ".log");
+    error_code error;
+    long long fileSize = std::filesystem::file_size(path, error);
+    if (error || fileSize <= segment.size)
+        return;
+
+    if (::truncate(path.c_str(), segment.size) != 0)
+        throw runtime_error("Failed to truncate torn log tail.");
+    recovery.bytesTruncated += fileSize - segment.size;
+}
+
+void SegmentedLog::ensureIndex(Segment& segment)
+{
+    if (segment.indexLoaded)
+        return;
+
+    loadIndex(segment);
+    if (segment.index.empty())
+    {
+        Segment scanned = { segment.firstMessage, 0, 0, {}, false, nullptr, 0 };
+        scanTail(scanned);
+        segment.index = move(scanned.index);
+    }
+    segment.indexLoaded = true;
+}
+
+void SegmentedLog::reload()
+{
+    closeFiles();
+    unmapSegments();
+    segments.clear();
+    messageCount = 0;
+    flushedCount = 0;
+
+    loadSegments(false);
+    openActiveSegment();
+}
+
+void SegmentedLog::scanSegment(Segment& segment)
+{
+    segment.messageCount = 0;
+    segment.size = 0;
+    segment.index.clear();
+    segment.indexLoaded = true;
+
+    scanTail(segment);
+}
+
+void SegmentedLog::scanTail(Segment& segment)
+{
+    int fd = ::open(segmentPath(segment.firstMessage, ".log").c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    string block;
+    long long blockStart = segment.size;
+    long long position = segment.size;
+
+    while (true)
+    {
+        if (position + HEADER_SIZE > blockStart + static_cast<long long>(block.size()))
+        {
+            blockStart = position;
+            block = readBytes(fd, blockStart, READ_BLOCK);
+            if (position + HEADER_SIZE > blockStart + static_cast<long long>(block.size()))
+                break;
+        }
+
+        uint32_t length = getUint32(&block[position - blockStart]);
+        uint32_t checksum = getUint32(&block[position - blockStart + 4]);
+        if (length > MAX_RECORD_SIZE)
+            break;
+
+        long long recordEnd = position + HEADER_SIZE + length;
+        if (recordEnd > blockStart + static_cast<long long>(block.size()))
+        {
+            blockStart = position;
+            block = readBytes(fd, blockStart, max<long long>(READ_BLOCK, HEADER_SIZE + length));
+            if (recordEnd > blockStart + static_cast<long long>(block.size()))
+                break;
+        }
+
+        if (crc32(&block[position - blockStart + HEADER_SIZE], length) != checksum)
+            break;
+
+        if (segment.messageCount % INDEX_INTERVAL == 0)
+        {
+            IndexEntry entry = { static_cast<uint32_t>(segment.messageCount), static_cast<uint32_t>(position) };
+            segment.index.push_back(entry);
+        }
+
+        segment.messageCount++;
+        position = recordEnd;
+    }
+
+    segment.size = position;
+    ::close(fd);
+}
+
+void SegmentedLog::loadIndex(Segment& segment)
+{
+    int fd = ::open(segmentPath(segment.firstMessage, ".idx").c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    string bytes = readBytes(fd, 0, segment.messageCount / INDEX_INTERVAL * 8 + 8);
+    ::close(fd);
+
+    for (size_t offset = 0; offset + 8 <= bytes.size(); offset += 8)
+    {
+        IndexEntry entry = { getUint32(&bytes[offset]), getUint32(&bytes[offset + 4]) };
+        if (entry.relativeMessage >= segment.messageCount || entry.position >= segment.size)
+            break;
+        segment.index.push_back(entry);
+    }
+
+    if (!segment.index.empty() && segment.index.front().relativeMessage != 0)
+    {
+        segment.index.clear();
+    }
+}
+
+void SegmentedLog::openActiveSegment()
+{
+    const Segment& active = segments.back();
+
+    activeFd = ::open(segmentPath(active.firstMessage, ".log").c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (activeFd < 0)
+        throw runtime_error("Failed to open log segment for writing.");
+
+    struct stat status;
+    activeInode = ::fstat(activeFd, &status) == 0 ? status.st_ino : 0;
+
+    // The active segment's index was rebuilt by scanning, so rewrite it to match the recovered tail.
+    activeIndexFd = ::open(segmentPath(active.firstMessage, ".idx").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (activeIndexFd < 0)
+        throw runtime_error("Failed to open log index for writing.");
+
+    string entries;
+    for (const IndexEntry& entry : active.index)
+    {
+        putUint32(entries, entry.relativeMessage);
+        putUint32(entries, entry.position);
+    }
+    writeAll(activeIndexFd, entries.data(), entries.size());
+}
+
+void SegmentedLog::rollSegment()
+{
+    flush();
+    closeFiles();
+
+    Segment segment = { messageCount, 0, 0, {}, true, nullptr, 0 };
+    segments.push_back(move(segment));
+
+    openActiveSegment();
+
+    if (static_cast<long long>(segments.size()) - 1 - snapshotSegments >= SNAPSHOT_INTERVAL)
+    {
+        writeSnapshot();
+    }
+}
+
+void SegmentedLog::closeFiles()
+{
+    if (activeFd >= 0)
+        ::close(activeFd);
+    if (activeIndexFd >= 0)
+        ::close(activeIndexFd);
+    if (readFd >= 0)
+        ::close(readFd);
+
+    activeFd = -1;
+    activeIndexFd = -1;
+    readFd = -1;
+    readSegment = -1;
+}
+
+int SegmentedLog::findSegment(long long messageNumber) const
+{
+    auto segment = upper_bound(segments.begin(), segments.end(), messageNumber,
+        [](long long value, const Segment& candidate) { return value < candidate.firstMessage; });
+    return static_cast<int>(segment - segments.begin()) - 1;
+}
+
+int SegmentedLog::openForRead(int segmentIndex)
+{
+    if (readSegment == segmentIndex && readFd >= 0)
+        return readFd;
+
+    if (readFd >= 0)
+        ::close(readFd);
+
+    readFd = ::open(segmentPath(segments[segmentIndex].firstMessage, ".log").c_str(), O_RDONLY);
+    if (readFd < 0)
+        throw runtime_error("Failed to open log segment for reading.");
+
+    readSegment = segmentIndex;
+    return readFd;
+}
+
+const char* SegmentedLog::mapSegment(int segmentIndex)
+{
+    Segment& segment = segments[segmentIndex];
+    if (segment.mapped && segment.mappedLength >= segment.size)
+        return segment.mapped;
+
+    if (segment.mapped)
+    {
+        Mapping retired = { segment.mapped, segment.mappedLength };
+        retiredMappings.push_back(retired);
+    }
+
+    // Only the active segment keeps growing, so it is mapped at the full segment size up front.
+    bool active = segmentIndex + 1 == static_cast<int>(segments.size());
+    long long length = active ? max(segmentSize, segment.size) : segment.size;
+
+    int fd = openForRead(segmentIndex);
+    void* data = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+        throw runtime_error("Failed to map log segment.");
+
+    segment.mapped = static_cast<const char*>(data);
+    segment.mappedLength = length;
+    return segment.mapped;
+}
+
+void SegmentedLog::unmapSegments()
+{
+    for (Segment& segment : segments)
+    {
+        if (segment.mapped)
+            ::munmap(const_cast<char*>(segment.mapped), segment.mappedLength);
+
+        segment.mapped = nullptr;
+        segment.mappedLength = 0;
+    }
+
+    for (const Mapping& mapping : retiredMappings)
+    {
+        ::munmap(const_cast<char*>(mapping.data), mapping.length);
+    }
+    retiredMappings.clear();
+}
@@ -0,0 +1,246 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#ifndef SEGMENTEDLOG_H
+#define SEGMENTEDLOG_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+using namespace std;
+
+class IoRing;
+
+// What the most recent load of a SegmentedLog found and repaired, and how long it took.
+struct RecoveryReport
+{
+    long long segmentsLoaded;
+    long long segmentsFromSnapshot;
+    long long recordsScanned;
+    long long bytesTruncated;
+    long long segmentsDiscarded;
+    long long microseconds;
+};
+
+class SegmentedLog
+{
+    // Class invariant:
+    // - SegmentedLog is an append-only log of messages stored as binary records across fixed-size segment files.
+    // - Every record is framed as [uint32 length][uint32 crc32][payload] so that torn or corrupted records can be detected.
+    // - Segment files are named "<basePath>.<first message number>.log", each paired with a sparse "<...>.idx" offset index.
+    // - Messages are numbered sequentially from 0 across all segments; the numbering never has gaps.
+    // - Appends are buffered in memory and written to the active segment sequentially when flushed.
+    // - Reads locate a message through the sparse index and scan forward at most INDEX_INTERVAL records.
+    // - Clients must be prepared to handle runtime_error on I/O failures and out_of_range on invalid message numbers.
+
+    private:
+        struct IndexEntry
+        {
+            uint32_t relativeMessage;
+            uint32_t position;
+        };
+
+        struct Segment
+        {
+            long long firstMessage;
+            long long messageCount;
+            long long size;
+            vector<IndexEntry> index;
+            bool indexLoaded;
+            const char* mapped;
+            long long mappedLength;
+        };
+
+        struct Mapping
+        {
+            const char* data;
+            long long length;
+        };
+
+        static const int HEADER_SIZE = 8;
+        static const int INDEX_INTERVAL = 16;
+        static const int SNAPSHOT_INTERVAL = 8;
+        static const uint32_t SNAPSHOT_MAGIC = 0x50345350;
+
+        string basePath;
+        long long segmentSize;
+        vector<Segment> segments;
+        long long messageCount;
+        long long flushedCount;
+
+        int activeFd;
+        int activeIndexFd;
+        unsigned long long activeInode;
+        string writeBuffer;
+        string indexBuffer;
+        bool syncOnFlush;
+
+        int readFd;
+        int readSegment;
+        vector<Mapping> retiredMappings;
+        RecoveryReport recovery;
+        long long snapshotSegments;
+        bool created;
+
+        string segmentPath(long long firstMessage, const string& extension) const;
+        void loadSegments(bool repair);
+        bool verifySealedSegment(Segment& segment, long long expectedCount);
+        void truncateTail(const Segment& segment);
+        void ensureIndex(Segment& segment);
+        size_t loadSnapshot(const vector<long long>& firstMessages, bool repair);
+        void scanSegment(Segment& segment);
+        void scanTail(Segment& segment);
+        void reload();
+        void loadIndex(Segment& segment);
+        void openActiveSegment();
+        void rollSegment();
+        void closeFiles();
+        int findSegment(long long messageNumber) const;
+        int openForRead(int segmentIndex);
+        const char* mapSegment(int segmentIndex);
+        void unmapSegments();
+
+        SegmentedLog(const SegmentedLog& other);
+        SegmentedLog& operator=(const SegmentedLog& other);
+
+    public:
+        static const long long DEFAULT_SEGMENT_SIZE = 4 * 1024 * 1024;
+        static const int MAX_RECORD_SIZE = 1024 * 1024;
+
+        // Preconditions:
+        // - basePath must be a non-empty path prefix in a writable directory.
+        // - segmentSize must be greater than HEADER_SIZE.
+        // - No other process may be writing to basePath while the log is opened.
+        // Postconditions:
+        // - Existing segments for basePath are discovered and recovered: each sealed segment is checked by validating
+        //   the records after its last index entry, and the active segment is scanned.
+        // - A torn or corrupt record ends the log. Bytes after the last valid record are truncated from the file and
+        //   any later segments are deleted, so the log is positioned for appending after the last valid record.
+        // - Segments recorded in the latest snapshot are taken from it without reading their files, and only records
+        //   appended after it are replayed. Each segment sealed since costs a bounded tail check, and without a snapshot
+        //   the active segment is scanned in full. Indexes of sealed segments are loaded on their first read.
+        SegmentedLog(const string& basePath, long long segmentSize = DEFAULT_SEGMENT_SIZE);
+
+        // Postconditions:
+        // - Any buffered records are flushed, a snapshot is written and all file descriptors are closed.
+        ~SegmentedLog();
+
+        // Preconditions:
+        // - message must be no longer than MAX_RECORD_SIZE bytes.
+        // Postconditions:
+        // - The message is framed into the write buffer and assigned the next message number.
+        // - A new segment is started first if the record would not fit in the active one.
+        void append(string_view message);
+
+        // Postconditions:
+        // - All buffered records and index entries are written to disk with one write call per file.
+        // - If syncOnFlush is set, the segment data is forced to stable storage before returning.
+        void flush();
+
+        // Postconditions:
+        // - The buffered records and index entries are queued on ring as one write per file (the record write followed
+        //   by an fdatasync if syncOnFlush is set) instead of being written here.
+        // - ring must be submitted before this log is used again. The records count as flushed once submit has
+        //   completed their write (and sync); if it fails, whatever it did not write is returned to the buffers, so
+        //   the next flush writes exactly the missing bytes and syncs, and nothing is lost.
+        void queueFlush(IoRing& ring);
+
+        // Postconditions:
+        // - Every subsequent flush, including the one made when rolling to a new segment, fsyncs the segment.
+        void setSyncOnFlush(bool sync);
+
+        // Postconditions:
+        // - Buffered records are flushed and "<basePath>.snapshot" is atomically replaced with the layout of every
+        //   segment, so the next open replays only what is appended after it. Also done every SNAPSHOT_INTERVAL rolls
+        //   and on destruction.
+        void writeSnapshot();
+
+        // Preconditions:
+        // - messageNumber must be within [0, getMessageCount()).
+        // Postconditions:
+        // - Returns the payload of the requested message after verifying its checksum.
+        string read(long long messageNumber);
+
+        // Preconditions:
+        // - The range [startRange, endRange) must lie within [0, getMessageCount()].
+        // Postconditions:
+        // - Returns the messages in the range, read with a single seek followed by a sequential scan.
+        unique_ptr<string[]> readRange(long long startRange, long long endRange);
+
+        // Preconditions:
+        // - The range [startRange, endRange) must lie within [0, getMessageCount()].
+        // Postconditions:
+        // - Returns views of the messages in the range pointing directly into read-only memory mappings of the
+        //   segment files; no payload bytes are copied.
+        // - The views stay valid until clear(), a refresh() that returns true, or destruction of the log.
+        vector<string_view> viewRange(long long startRange, long long endRange);
+
+        // Postconditions:
+        // - If no other writer has touched the log, returns false with buffered records left in the buffer, so
+        //   reads that refresh do not break up batched writes; checking costs a stat and an access call.
+        // - Otherwise buffered records are flushed and only the bytes past the last known tail are scanned to pick
+        //   up records appended by other writers sharing basePath, following any segments they rolled to.
+        // - If the active segment was truncated, removed or replaced, the whole log is reloaded and true is
+        //   returned to signal that previously read message numbers may no longer hold the same records.
+        bool refresh();
+
+        // Postconditions:
+        // - All segment and index files are removed and the log is empty.
+        void clear();
+
+        // Preconditions:
+        // - count must be within [0, getMessageCount()].
+        // Postconditions:
+        // - Only the first count messages remain: segments after the one holding message count are deleted and that
+        //   segment's records before the cut are copied to a new file that replaces it, so the cost is bounded by
+        //   the segment size rather than the log size.
+        // - Other handles on basePath see a replaced segment on their next refresh and reload.
+        // - Views returned by viewRange expire, and the snapshot is removed until the next one is written.
+        void truncate(long long count);
+
+        long long getMessageCount() const;
+        long long getSegmentCount() const;
+
+        // Postconditions:
+        // - Returns what the most recent load (construction, or a reload after the log was replaced) found and repaired.
+        //   Reloads never truncate or delete, so their bytesTruncated and segmentsDiscarded are always 0.
+        RecoveryReport getRecoveryReport() const;
+
+        // Postconditions:
+        // - Returns true if construction found no segments for basePath, so this handle created the log empty.
+        bool wasCreated() const;
+
+        static uint32_t crc32(const char* data, size_t length);
+};
+
+// Implementation invariant:
+// - segments is ordered by firstMessage and the last entry is always the active segment open for appending.
+// - flushedCount <= messageCount; records in [flushedCount, messageCount) are not yet known to be on disk. Their
+//   unwritten bytes are in writeBuffer; the rest were written by a failed queueFlush submit and may still need a sync.
+// - Each Segment::index entry maps a relative message number to the byte position of its record header, and
+//   an entry is recorded for every INDEX_INTERVAL-th message of the segment.
+// - Segment sizes and index positions include buffered bytes so that roll decisions never need a flush.
+// - A record that fails framing or checksum validation during a scan marks the end of the readable log.
+//   A sealed segment that holds fewer valid records than the next segment's name implies is torn; the log ends there.
+// - truncate replaces the segment it cuts back with a new file (a new inode), so another handle detects the cut by
+//   inode however far the segment has grown again since. It also resets snapshotSegments with the snapshot it
+//   removes, so snapshots resume SNAPSHOT_INTERVAL segments after the cut.
+// - Only the constructor repairs (truncates and deletes). A reload triggered by refresh may race with another writer's
+//   flush, so it stops at a torn record without touching the files.
+// - A sealed segment's index is loaded on first use (indexLoaded); the active segment's is always in memory.
+// - The snapshot lists segments as [first, count, size, inode] entries followed by a CRC of the whole file. It is used
+//   only if the CRC matches, its segments are exactly the first ones found on disk, and the last sealed one still has
+//   the recorded size and inode. If it also records the current active segment, that file may only have grown, and
+//   the active index is loaded from its .idx for the recorded prefix before the rest is scanned. Otherwise the load
+//   falls back to checking every segment. snapshotSegments is the number of sealed segments the snapshot covers.
+// - activeInode identifies the file activeFd was opened on, so refresh can tell an appended segment from a replaced one.
+// - A segment is mapped on its first view; the active segment is mapped at segmentSize so it can grow in place.
+//   A mapping that becomes too short (an oversized record) is replaced, and the old one is kept in
+//   retiredMappings so views already handed out never dangle before clear, reload or destruction.
+// - readFd caches a descriptor for the most recently read segment so that random reads avoid reopening files.
+
+#endif
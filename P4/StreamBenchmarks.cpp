@@ -0,0 +1,420 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+// Regression benchmarks for the stream classes, built on Google Benchmark.
+// Build: g++ -std=c++17 -O2 -pthread StreamBenchmarks.cpp MsgStream.cpp MessageArena.cpp DurableStream.cpp PartitionStream.cpp SegmentedLog.cpp BackgroundFlusher.cpp IoRing.cpp StreamMetrics.cpp InMemoryStream.cpp -lbenchmark -o StreamBenchmarks
+// Run:   ./StreamBenchmarks --baseline=StreamBenchmarks.json
+// Refresh the baseline: ./StreamBenchmarks --benchmark_out=StreamBenchmarks.json --benchmark_out_format=json
+//
+// Every fixture is rebuilt from fixed message sets and fixed seeds, and durable fixtures work in their own files that
+// are removed afterwards, so two runs on the same machine measure the same work. With --baseline, each result is
+// printed next to the baseline time of the same benchmark and the run fails if any is slower by more than
+// --regression_threshold percent (10 by default).
+
+#include "MsgStream.h"
+#include "DurableStream.h"
+#include "PartitionStream.h"
+#include "InMemoryStream.h"
+#include "SegmentedLog.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <random>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <filesystem>
+
+#include <unistd.h>
+
+using namespace std;
+
+const int MESSAGE_SET_SIZE = 1024;
+const int DURABLE_CAPACITY = 200;
+const int MAX_MESSAGE_LENGTH = 150;
+const unsigned SEED = 3200;
+
+// The same messages in the same order on every run: lengths 1..150 drawn from a fixed seed
+const vector<string>& messageSet() {
+    static const vector<string> messages = []() {
+        mt19937 generator(SEED);
+        uniform_int_distribution<int> length(1, MAX_MESSAGE_LENGTH);
+        vector<string> result;
+        for (int i = 0; i < MESSAGE_SET_SIZE; i++) {
+            result.push_back(string(length(generator), static_cast<char>('a' + i % 26)));
+        }
+        return result;
+    }();
+    return messages;
+}
+
+const string& messageAt(long long index) {
+    return messageSet()[index % MESSAGE_SET_SIZE];
+}
+
+unique_ptr<MsgStream> filledStream(int count) {
+    unique_ptr<MsgStream> stream(new MsgStream(count, CapacityMode::Growable));
+    stream->setOperationBudget(BudgetPolicy::unlimited());
+    for (int i = 0; i < count; i++) {
+        stream->appendMessage(messageAt(i));
+    }
+    return stream;
+}
+
+void removeFiles(const string& prefix) {
+    for (const auto& entry : filesystem::directory_iterator(".")) {
+        if (entry.path().filename().string().rfind(prefix + ".", 0) == 0) {
+            filesystem::remove(entry.path());
+        }
+    }
+}
+
+// MsgStream
+
+void BM_MsgStreamAppend(benchmark::State& state) {
+    MsgStream stream(MESSAGE_SET_SIZE, CapacityMode::Growable, RetentionPolicy::keepLatest());
+    long long next = 0;
+    for (auto _ : state) {
+        stream.appendMessage(messageAt(next++));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MsgStreamAppend);
+
+// The same appends with metrics enabled, to show what the counters and histograms cost
+void BM_MsgStreamAppendInstrumented(benchmark::State& state) {
+    MsgStream stream(MESSAGE_SET_SIZE, CapacityMode::Growable, RetentionPolicy::keepLatest());
+    stream.enableMetrics();
+    long long next = 0;
+    for (auto _ : state) {
+        stream.appendMessage(messageAt(next++));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MsgStreamAppendInstrumented);
+
+// The same appends on a stream whose policies drop message validation and the operation budget
+void BM_TrustedMsgStreamAppend(benchmark::State& state) {
+    TrustedMsgStream stream(MESSAGE_SET_SIZE, CapacityMode::Growable, RetentionPolicy::keepLatest());
+    long long next = 0;
+    for (auto _ : state) {
+        stream.appendMessage(messageAt(next++));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TrustedMsgStreamAppend);
+
+void BM_MsgStreamAppendBatch(benchmark::State& state) {
+    const int batchSize = static_cast<int>(state.range(0));
+    MsgStream stream(MESSAGE_SET_SIZE, CapacityMode::Growable, RetentionPolicy::keepLatest());
+    vector<string_view> batch(messageSet().begin(), messageSet().begin() + batchSize);
+    for (auto _ : state) {
+        stream.appendBatch(batch.data(), batchSize);
+    }
+    state.SetItemsProcessed(state.iterations() * batchSize);
+}
+BENCHMARK(BM_MsgStreamAppendBatch)->Arg(16)->Arg(256);
+
+void BM_MsgStreamReadMessages(benchmark::State& state) {
+    const int range = static_cast<int>(state.range(0));
+    unique_ptr<MsgStream> stream = filledStream(MESSAGE_SET_SIZE);
+    long long start = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(stream->readMessages(start, start + range));
+        start = (start + range) % (MESSAGE_SET_SIZE - range);
+    }
+    state.SetItemsProcessed(state.iterations() * range);
+}
+BENCHMARK(BM_MsgStreamReadMessages)->Arg(1)->Arg(64);
+
+void BM_MsgStreamViewMessages(benchmark::State& state) {
+    const int range = static_cast<int>(state.range(0));
+    unique_ptr<MsgStream> stream = filledStream(MESSAGE_SET_SIZE);
+    long long start = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(stream->viewMessages(start, start + range));
+        start = (start + range) % (MESSAGE_SET_SIZE - range);
+    }
+    state.SetItemsProcessed(state.iterations() * range);
+}
+BENCHMARK(BM_MsgStreamViewMessages)->Arg(1)->Arg(64);
+
+void BM_MsgStreamCopy(benchmark::State& state) {
+    unique_ptr<MsgStream> stream = filledStream(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        MsgStream copy(*stream);
+        benchmark::DoNotOptimize(copy.getMessageCount());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_MsgStreamCopy)->Arg(16)->Arg(1024);
+
+void BM_MsgStreamMerge(benchmark::State& state) {
+    unique_ptr<MsgStream> left = filledStream(static_cast<int>(state.range(0)));
+    unique_ptr<MsgStream> right = filledStream(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        MsgStream merged = *left + *right;
+        benchmark::DoNotOptimize(merged.getMessageCount());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0) * 2);
+}
+BENCHMARK(BM_MsgStreamMerge)->Arg(16)->Arg(1024);
+
+// PartitionStream
+
+class PartitionFixture : public benchmark::Fixture {
+    public:
+        unique_ptr<PartitionStream> stream;
+        vector<int> keys;
+
+        void SetUp(const benchmark::State& state) override {
+            const int partitions = static_cast<int>(state.range(0));
+            unique_ptr<MsgStream[]> streams(new MsgStream[static_cast<unsigned>(partitions)]);
+            stream = unique_ptr<PartitionStream>(new PartitionStream(partitions, move(streams), CapacityMode::Growable));
+            for (int i = 0; i < partitions; i++) {
+                stream->setPartition(i, makePartition());
+            }
+
+            // A fixed, shuffled key order so writes do not walk the partitions in sequence
+            mt19937 generator(SEED);
+            uniform_int_distribution<int> key(1, partitions);
+            keys.clear();
+            for (int i = 0; i < MESSAGE_SET_SIZE; i++) {
+                keys.push_back(key(generator));
+            }
+        }
+
+        void TearDown(const benchmark::State&) override {
+            stream.reset();
+        }
+
+        // InMemoryStream partitions, which PartitionStream calls without virtual dispatch
+        virtual unique_ptr<MsgStream> makePartition() {
+            return unique_ptr<MsgStream>(
+                new InMemoryStream(MESSAGE_SET_SIZE, CapacityMode::Growable, RetentionPolicy::keepLatest()));
+        }
+};
+
+// The same partitions as plain MsgStreams, which PartitionStream reaches through the virtual interface
+class VirtualPartitionFixture : public PartitionFixture {
+    public:
+        unique_ptr<MsgStream> makePartition() override {
+            return unique_ptr<MsgStream>(
+                new MsgStream(MESSAGE_SET_SIZE, CapacityMode::Growable, RetentionPolicy::keepLatest()));
+        }
+};
+
+void writePartitions(PartitionStream& stream, const vector<int>& keys, benchmark::State& state) {
+    long long next = 0;
+    for (auto _ : state) {
+        stream.writeMessage(keys[next % MESSAGE_SET_SIZE], messageAt(next));
+        next++;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_DEFINE_F(PartitionFixture, Write)(benchmark::State& state) {
+    writePartitions(*stream, keys, state);
+}
+BENCHMARK_REGISTER_F(PartitionFixture, Write)->Arg(1)->Arg(16)->Arg(256);
+
+BENCHMARK_DEFINE_F(VirtualPartitionFixture, Write)(benchmark::State& state) {
+    writePartitions(*stream, keys, state);
+}
+BENCHMARK_REGISTER_F(VirtualPartitionFixture, Write)->Arg(1)->Arg(16)->Arg(256);
+
+BENCHMARK_DEFINE_F(PartitionFixture, Read)(benchmark::State& state) {
+    // At most MESSAGE_SET_SIZE messages per partition, so nothing is evicted and offset 0 stays readable
+    for (int i = 0; i < MESSAGE_SET_SIZE; i++) {
+        stream->writeMessage(keys[i % MESSAGE_SET_SIZE], messageAt(i));
+    }
+    long long next = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(stream->readMessage(keys[next % MESSAGE_SET_SIZE], 0, 1));
+        next++;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_REGISTER_F(PartitionFixture, Read)->Arg(1)->Arg(16)->Arg(256);
+
+// DurableStream
+
+class DurableFixture : public benchmark::Fixture {
+    public:
+        const string prefix = "stream_benchmark";
+        unique_ptr<DurableStream> stream;
+
+        void SetUp(const benchmark::State&) override {
+            removeFiles(prefix);
+            stream = unique_ptr<DurableStream>(new DurableStream(DURABLE_CAPACITY, prefix));
+            stream->setOperationBudget(BudgetPolicy::unlimited());
+        }
+
+        void TearDown(const benchmark::State&) override {
+            stream.reset();
+            removeFiles(prefix);
+        }
+};
+
+// A DurableStream holds at most 200 messages, so it is reset (untimed) whenever it fills up
+BENCHMARK_DEFINE_F(DurableFixture, Append)(benchmark::State& state) {
+    long long next = 0;
+    for (auto _ : state) {
+        stream->appendMessage(messageAt(next++));
+        if (stream->getMessageCount() == DURABLE_CAPACITY) {
+            state.PauseTiming();
+            stream->reset();
+            state.ResumeTiming();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_REGISTER_F(DurableFixture, Append);
+
+// Each iteration another handle appends one record and the stream picks it up on its next read. Once the stream
+// is full, both are reopened (untimed) over fresh files so every timed read ingests a new record.
+BENCHMARK_DEFINE_F(DurableFixture, Sync)(benchmark::State& state) {
+    unique_ptr<SegmentedLog> writer(new SegmentedLog(prefix));
+    long long next = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        writer->append(messageAt(next++));
+        writer->flush();
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(stream->readMessages(0, 1));
+        if (stream->getMessageCount() == DURABLE_CAPACITY) {
+            state.PauseTiming();
+            writer.reset();
+            TearDown(state);
+            SetUp(state);
+            writer = unique_ptr<SegmentedLog>(new SegmentedLog(prefix));
+            state.ResumeTiming();
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_REGISTER_F(DurableFixture, Sync);
+
+// Reset after range(0) appended messages; only the reset is timed
+BENCHMARK_DEFINE_F(DurableFixture, Reset)(benchmark::State& state) {
+    const int appended = static_cast<int>(state.range(0));
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (int i = 0; i < appended; i++) {
+            stream->appendMessage(messageAt(i));
+        }
+        state.ResumeTiming();
+        stream->reset();
+    }
+}
+BENCHMARK_REGISTER_F(DurableFixture, Reset)->Arg(1)->Arg(200);
+
+// Reports each run next to the baseline time of the benchmark with the same name
+class BaselineReporter : public benchmark::ConsoleReporter {
+    public:
+        BaselineReporter(const map<string, double>& baseline, double threshold)
+            : ConsoleReporter(isatty(STDOUT_FILENO) ? OO_ColorTabular : OO_Tabular),
+              baseline(baseline), threshold(threshold), regressions(0) {}
+
+        void ReportRuns(const vector<Run>& runs) override {
+            ConsoleReporter::ReportRuns(runs);
+            for (const Run& run : runs) {
+                auto entry = baseline.find(run.benchmark_name());
+                if (entry == baseline.end() || run.error_occurred) {
+                    continue;
+                }
+
+                double nanoseconds = run.GetAdjustedRealTime() / benchmark::GetTimeUnitMultiplier(run.time_unit) * 1e9;
+                double change = (nanoseconds / entry->second - 1) * 100;
+                bool regressed = change > threshold;
+                regressions += regressed ? 1 : 0;
+                GetOutputStream() << "    vs baseline " << fixed << setprecision(1) << showpos << change << noshowpos
+                                  << "%" << (regressed ? "  REGRESSION" : "") << "\n";
+            }
+        }
+
+        int getRegressions() const { return regressions; }
+
+    private:
+        map<string, double> baseline;
+        double threshold;
+        int regressions;
+};
+
+// Reads name and real_time (in ns) from a Google Benchmark JSON file, which writes one field per line
+map<string, double> loadBaseline(const string& path) {
+    ifstream file(path);
+    if (!file) {
+        throw runtime_error("Cannot open baseline " + path);
+    }
+
+    map<string, double> times;
+    string line;
+    string name;
+    double realTime = 0;
+    auto field = [](const string& text) {
+        size_t colon = text.find(':');
+        string value = text.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(" \""));
+        value.erase(value.find_last_not_of(" \",") + 1);
+        return value;
+    };
+
+    while (getline(file, line)) {
+        if (line.find("\"name\":") != string::npos) {
+            name = field(line);
+        } else if (line.find("\"real_time\":") != string::npos) {
+            realTime = stod(field(line));
+        } else if (line.find("\"time_unit\":") != string::npos && !name.empty()) {
+            string unit = field(line);
+            double scale = unit == "s" ? 1e9 : unit == "ms" ? 1e6 : unit == "us" ? 1e3 : 1;
+            times[name] = realTime * scale;
+            name.clear();
+        }
+    }
+    return times;
+}
+
+int main(int argc, char** argv) {
+    string baselinePath;
+    double threshold = 10;
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--baseline=", 11) == 0) {
+            baselinePath = argv[i] + 11;
+        } else if (strncmp(argv[i], "--regression_threshold=", 23) == 0) {
+            threshold = atof(argv[i] + 23);
+        } else {
+            argv[kept++] = argv[i];
+        }
+    }
+    argc = kept;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+
+    try {
+        BaselineReporter reporter(baselinePath.empty() ? map<string, double>() : loadBaseline(baselinePath), threshold);
+        benchmark::RunSpecifiedBenchmarks(&reporter);
+        benchmark::Shutdown();
+
+        if (reporter.getRegressions() > 0) {
+            cerr << reporter.getRegressions() << " benchmark(s) regressed by more than " << threshold << "%" << endl;
+            return 1;
+        }
+    } catch (const exception& e) {
+        cerr << "Exception occurred: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
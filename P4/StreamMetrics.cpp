@@ -0,0 +1,316 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#include "StreamMetrics.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <array>
+#include <utility>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    const char* const REASON_NAMES[] = { "full", "operation_limit", "invalid" };
+    const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+
+    void add(atomic<long long>& counter, long long amount)
+    {
+        counter.fetch_add(amount, memory_order_relaxed);
+    }
+
+    string seriesName(const string& name, const string& labels, const string& extra = "")
+    {
+        string all = labels.empty() ? extra : extra.empty() ? labels : labels + "," + extra;
+        return all.empty() ? name : name + "{" + all + "}";
+    }
+
+    void writeCounter(ostringstream& out, const string& family, const string& help,
+        const vector<pair<string, StreamMetricsSnapshot>>& series, long long StreamMetricsSnapshot::* counter)
+    {
+        out << "# HELP " << family << " " << help << "\n";
+        out << "# TYPE " << family << " counter\n";
+        for (const auto& entry : series)
+        {
+            out << seriesName(family, entry.first) << " " << entry.second.*counter << "\n";
+        }
+    }
+
+    void writeSummary(ostringstream& out, const string& family, const string& help,
+        const vector<pair<string, StreamMetricsSnapshot>>& series, HistogramSnapshot StreamMetricsSnapshot::* histogram)
+    {
+        out << "# HELP " << family << " " << help << "\n";
+        out << "# TYPE " << family << " summary\n";
+        for (const auto& entry : series)
+        {
+            const HistogramSnapshot& samples = entry.second.*histogram;
+            for (double quantile : QUANTILES)
+            {
+                ostringstream label;
+                label << "quantile=\"" << quantile << "\"";
+                out << seriesName(family, entry.first, label.str()) << " " << samples.percentile(quantile) / 1e9 << "\n";
+            }
+            out << seriesName(family + "_sum", entry.first) << " " << samples.sum / 1e9 << "\n";
+            out << seriesName(family + "_count", entry.first) << " " << samples.count << "\n";
+        }
+    }
+}
+
+long long HistogramSnapshot::percentile(double quantile) const
+{
+    if (quantile < 0 || quantile > 1)
+        throw invalid_argument("Quantile must be within [0, 1].");
+
+    if (count == 0)
+        return 0;
+
+    long long rank = max<long long>(1, static_cast<long long>(ceil(quantile * count)));
+    long long seen = 0;
+    for (size_t bucket = 0; bucket < counts.size(); bucket++)
+    {
+        seen += counts[bucket];
+        if (seen >= rank)
+            return LatencyHistogram::bucketLimit(static_cast<int>(bucket));
+    }
+    return LatencyHistogram::MAX_NANOSECONDS;
+}
+
+double HistogramSnapshot::mean() const
+{
+    return count == 0 ? 0 : static_cast<double>(sum) / count;
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot& other)
+{
+    counts.resize(max(counts.size(), other.counts.size()), 0);
+    for (size_t bucket = 0; bucket < other.counts.size(); bucket++)
+    {
+        counts[bucket] += other.counts[bucket];
+    }
+    count += other.count;
+    sum += other.sum;
+}
+
+LatencyHistogram::LatencyHistogram() : count(0), sum(0)
+{
+    for (atomic<long long>& bucket : counts)
+    {
+        bucket.store(0, memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::record(long long nanoseconds)
+{
+    if (nanoseconds < 0)
+    {
+        nanoseconds = 0;
+    }
+    else if (nanoseconds > MAX_NANOSECONDS)
+    {
+        nanoseconds = MAX_NANOSECONDS;
+    }
+    add(counts[bucketFor(nanoseconds)], 1);
+    add(count, 1);
+    add(sum, nanoseconds);
+}
+
+HistogramSnapshot LatencyHistogram::snapshot() const
+{
+    HistogramSnapshot result = { vector<long long>(BUCKET_COUNT), 0, 0 };
+    for (int bucket = 0; bucket < BUCKET_COUNT; bucket++)
+    {
+        result.counts[bucket] = counts[bucket].load(memory_order_relaxed);
+        result.count += result.counts[bucket];
+    }
+    result.sum = sum.load(memory_order_relaxed);
+    return result;
+}
+
+int LatencyHistogram::bucketFor(long long nanoseconds)
+{
+    if (nanoseconds < SUB_BUCKETS)
+        return static_cast<int>(nanoseconds);
+
+    int exponent = 63 - __builtin_clzll(static_cast<unsigned long long>(nanoseconds));
+    int subBucket = static_cast<int>(nanoseconds >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + subBucket;
+}
+
+long long LatencyHistogram::bucketLimit(int bucket)
+{
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+
+    int exponent = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    long long subBucket = bucket % SUB_BUCKETS;
+    return ((SUB_BUCKETS + subBucket + 1) << (exponent - SUB_BUCKET_BITS)) - 1;
+}
+
+StreamMetricsSnapshot StreamMetricsSnapshot::empty()
+{
+    HistogramSnapshot none = { vector<long long>(LatencyHistogram::BUCKET_COUNT), 0, 0 };
+    return StreamMetricsSnapshot{ 0, 0, 0, 0, 0, 0, 0, 0, { 0, 0, 0 }, none, none, none, none };
+}
+
+long long StreamMetricsSnapshot::getRejections(RejectReason reason) const
+{
+    return rejections[static_cast<int>(reason)];
+}
+
+long long StreamMetricsSnapshot::getTotalRejections() const
+{
+    return rejections[0] + rejections[1] + rejections[2];
+}
+
+void StreamMetricsSnapshot::merge(const StreamMetricsSnapshot& other)
+{
+    appends += other.appends;
+    bytesAppended += other.bytesAppended;
+    reads += other.reads;
+    messagesRead += other.messagesRead;
+    flushes += other.flushes;
+    bytesFlushed += other.bytesFlushed;
+    syncs += other.syncs;
+    messagesSynced += other.messagesSynced;
+    for (size_t i = 0; i < rejections.size(); i++)
+    {
+        rejections[i] += other.rejections[i];
+    }
+    appendLatency.merge(other.appendLatency);
+    readLatency.merge(other.readLatency);
+    flushLatency.merge(other.flushLatency);
+    syncLatency.merge(other.syncLatency);
+}
+
+string StreamMetricsSnapshot::toPrometheus(const string& name) const
+{
+    return StreamMetrics::toPrometheus(name, { { "", *this } });
+}
+
+StreamMetrics::StreamMetrics()
+    : appends(0), bytesAppended(0), reads(0), messagesRead(0), flushes(0), bytesFlushed(0), syncs(0), messagesSynced(0)
+{
+    for (atomic<long long>& rejected : rejections)
+    {
+        rejected.store(0, memory_order_relaxed);
+    }
+}
+
+void StreamMetrics::recordAppend(long long messages, long long bytes, long long nanoseconds)
+{
+    add(appends, messages);
+    add(bytesAppended, bytes);
+    appendLatency.record(nanoseconds);
+}
+
+void StreamMetrics::recordRead(long long messages, long long nanoseconds)
+{
+    add(reads, 1);
+    add(messagesRead, messages);
+    readLatency.record(nanoseconds);
+}
+
+void StreamMetrics::recordFlush(long long bytes, long long nanoseconds)
+{
+    add(flushes, 1);
+    add(bytesFlushed, bytes);
+    if (nanoseconds >= 0)
+    {
+        flushLatency.record(nanoseconds);
+    }
+}
+
+void StreamMetrics::recordSync(long long messages, long long nanoseconds)
+{
+    add(syncs, 1);
+    add(messagesSynced, messages);
+    syncLatency.record(nanoseconds);
+}
+
+void StreamMetrics::recordRejection(RejectReason reason)
+{
+    add(rejections[static_cast<int>(reason)], 1);
+}
+
+StreamMetricsSnapshot StreamMetrics::snapshot() const
+{
+    StreamMetricsSnapshot result = {
+        appends.load(memory_order_relaxed), bytesAppended.load(memory_order_relaxed),
+        reads.load(memory_order_relaxed), messagesRead.load(memory_order_relaxed),
+        flushes.load(memory_order_relaxed), bytesFlushed.load(memory_order_relaxed),
+        syncs.load(memory_order_relaxed), messagesSynced.load(memory_order_relaxed),
+        { 0, 0, 0 },
+        appendLatency.snapshot(), readLatency.snapshot(), flushLatency.snapshot(), syncLatency.snapshot()
+    };
+    for (size_t i = 0; i < rejections.size(); i++)
+    {
+        result.rejections[i] = rejections[i].load(memory_order_relaxed);
+    }
+    return result;
+}
+
+string StreamMetrics::toPrometheus(const string& name, const vector<pair<string, StreamMetricsSnapshot>>& series)
+{
+    ostringstream out;
+    writeCounter(out, name + "_appends_total", "Messages appended.", series, &StreamMetricsSnapshot::appends);
+    writeCounter(out, name + "_appended_bytes_total", "Message bytes appended.", series,
+        &StreamMetricsSnapshot::bytesAppended);
+    writeCounter(out, name + "_reads_total", "Read operations served.", series, &StreamMetricsSnapshot::reads);
+    writeCounter(out, name + "_read_messages_total", "Messages returned by reads.", series,
+        &StreamMetricsSnapshot::messagesRead);
+    writeCounter(out, name + "_flushes_total", "Writes of buffered records to the backing file.", series,
+        &StreamMetricsSnapshot::flushes);
+    writeCounter(out, name + "_flushed_bytes_total", "Message bytes written to the backing file.", series,
+        &StreamMetricsSnapshot::bytesFlushed);
+    writeCounter(out, name + "_syncs_total", "Syncs with the backing file.", series, &StreamMetricsSnapshot::syncs);
+    writeCounter(out, name + "_synced_messages_total", "Messages picked up from the backing file.", series,
+        &StreamMetricsSnapshot::messagesSynced);
+
+    string rejected = name + "_rejected_total";
+    out << "# HELP " << rejected << " Operations refused, by reason.\n";
+    out << "# TYPE " << rejected << " counter\n";
+    for (const auto& entry : series)
+    {
+        for (size_t i = 0; i < entry.second.rejections.size(); i++)
+        {
+            out << seriesName(rejected, entry.first, string("reason=\"") + REASON_NAMES[i] + "\"") << " "
+                << entry.second.rejections[i] << "\n";
+        }
+    }
+
+    writeSummary(out, name + "_append_latency_seconds", "Time per append call.", series,
+        &StreamMetricsSnapshot::appendLatency);
+    writeSummary(out, name + "_read_latency_seconds", "Time per read call.", series,
+        &StreamMetricsSnapshot::readLatency);
+    writeSummary(out, name + "_flush_latency_seconds", "Time per write to the backing file.", series,
+        &StreamMetricsSnapshot::flushLatency);
+    writeSummary(out, name + "_sync_latency_seconds", "Time per sync with the backing file.", series,
+        &StreamMetricsSnapshot::syncLatency);
+    return out.str();
+}
+
+void StreamMetrics::writePrometheusFile(const string& path, const string& text)
+{
+    string temporary = path + ".tmp";
+    {
+        ofstream file(temporary, ios::binary | ios::trunc);
+        file << text;
+        if (!file.flush())
+            throw runtime_error("Failed to write metrics file.");
+    }
+
+    if (rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        remove(temporary.c_str());
+        throw runtime_error("Failed to write metrics file.");
+    }
+}
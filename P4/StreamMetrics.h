@@ -0,0 +1,217 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#ifndef STREAMMETRICS_H
+#define STREAMMETRICS_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <array>
+#include <utility>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+using namespace std;
+
+// Why a stream refused a client operation: it was at capacity, its operation budget was spent, or the message, range,
+// key or batch size was not valid.
+enum class RejectReason
+{
+    Full,
+    OperationLimit,
+    Invalid
+};
+
+// A point-in-time copy of a LatencyHistogram; bucket bounds come from LatencyHistogram::bucketLimit.
+struct HistogramSnapshot
+{
+    vector<long long> counts;
+    long long count;
+    long long sum;
+
+    // Preconditions:
+    // - quantile must be within [0, 1].
+    // Postconditions:
+    // - Returns the upper bound, in nanoseconds, of the bucket holding the quantile's sample, or 0 with no samples.
+    long long percentile(double quantile) const;
+
+    // Postconditions:
+    // - Returns the mean sample in nanoseconds, or 0 with no samples.
+    double mean() const;
+
+    // Postconditions:
+    // - other's samples are added to this snapshot's, as if both had been recorded into one histogram.
+    void merge(const HistogramSnapshot& other);
+};
+
+class LatencyHistogram
+{
+    // Class invariant:
+    // - LatencyHistogram counts nanosecond samples in HDR-style log-linear buckets: values below SUB_BUCKETS get a
+    //   bucket each and every later power of two is split into SUB_BUCKETS equal buckets, so a bucket's bounds are
+    //   within 12.5% of any value in it. Values past MAX_NANOSECONDS land in the last bucket.
+    // - record may run concurrently with snapshot; each sample costs three relaxed atomic additions and no lock.
+
+    public:
+        static const int SUB_BUCKET_BITS = 3;
+        static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        static const int MAX_EXPONENT = 36;
+        static const int BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+        static const long long MAX_NANOSECONDS = (1LL << (MAX_EXPONENT + 1)) - 1;
+
+        // Postconditions:
+        // - Every bucket is empty.
+        LatencyHistogram();
+
+        // Postconditions:
+        // - nanoseconds (clamped to [0, MAX_NANOSECONDS]) is counted in its bucket and added to the sum.
+        void record(long long nanoseconds);
+
+        // Postconditions:
+        // - Returns the counts recorded so far. Samples recorded during the call may be only partly included.
+        HistogramSnapshot snapshot() const;
+
+        // Postconditions:
+        // - Returns the bucket a value in [0, MAX_NANOSECONDS] is counted in.
+        static int bucketFor(long long nanoseconds);
+
+        // Postconditions:
+        // - Returns the largest value counted in bucket.
+        static long long bucketLimit(int bucket);
+
+    private:
+        array<atomic<long long>, BUCKET_COUNT> counts;
+        atomic<long long> count;
+        atomic<long long> sum;
+
+        LatencyHistogram(const LatencyHistogram& other);
+        LatencyHistogram& operator=(const LatencyHistogram& other);
+};
+
+// A point-in-time copy of a stream's StreamMetrics. Counters never decrease, so two snapshots can be subtracted.
+struct StreamMetricsSnapshot
+{
+    long long appends;
+    long long bytesAppended;
+    long long reads;
+    long long messagesRead;
+    long long flushes;
+    long long bytesFlushed;
+    long long syncs;
+    long long messagesSynced;
+    array<long long, 3> rejections;
+    HistogramSnapshot appendLatency;
+    HistogramSnapshot readLatency;
+    HistogramSnapshot flushLatency;
+    HistogramSnapshot syncLatency;
+
+    // Postconditions:
+    // - Returns a snapshot with every counter and histogram empty.
+    static StreamMetricsSnapshot empty();
+
+    long long getRejections(RejectReason reason) const;
+    long long getTotalRejections() const;
+
+    // Postconditions:
+    // - other's counters and histograms are added to this snapshot's.
+    void merge(const StreamMetricsSnapshot& other);
+
+    // Preconditions:
+    // - name must be a valid Prometheus metric name prefix.
+    // Postconditions:
+    // - Returns the snapshot in the Prometheus text exposition format, as for StreamMetrics::toPrometheus.
+    string toPrometheus(const string& name) const;
+};
+
+class alignas(64) StreamMetrics
+{
+    // Class invariant:
+    // - StreamMetrics holds the counters and latency histograms of one stream. Streams create it only when metrics are
+    //   enabled, so an uninstrumented stream pays one null check per operation and nothing else.
+    // - Every update is a relaxed atomic addition. A stream's updates come from its writer (or from whoever holds its
+    //   partition lock), so they never contend; snapshot may run on any thread at any time.
+    // - Counters only grow, as Prometheus counters expect; resetting a stream does not reset its metrics.
+
+    public:
+        // Postconditions:
+        // - Every counter and histogram is zero.
+        StreamMetrics();
+
+        // Postconditions:
+        // - messages appends totalling bytes bytes are counted, and the call that made them took nanoseconds.
+        void recordAppend(long long messages, long long bytes, long long nanoseconds);
+
+        // Postconditions:
+        // - One read returning messages messages is counted, taking nanoseconds.
+        void recordRead(long long messages, long long nanoseconds);
+
+        // Postconditions:
+        // - One write of bytes buffered bytes to the backing file is counted. nanoseconds is recorded in the flush
+        //   histogram unless it is negative, which marks a write queued elsewhere and timed by its submitter.
+        void recordFlush(long long bytes, long long nanoseconds);
+
+        // Postconditions:
+        // - One sync with the backing file that picked up messages new messages is counted, taking nanoseconds.
+        void recordSync(long long messages, long long nanoseconds);
+
+        // Postconditions:
+        // - One refused operation is counted under reason.
+        void recordRejection(RejectReason reason);
+
+        // Postconditions:
+        // - Returns the current counters and histograms. Taken without a lock, so an operation recorded during the
+        //   call may be included in some counters and not others.
+        StreamMetricsSnapshot snapshot() const;
+
+        // Postconditions:
+        // - Returns a steady clock reading in nanoseconds, for timing the operations passed to the record calls.
+        static long long now()
+        {
+            return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        // Preconditions:
+        // - name must be a valid Prometheus metric name prefix; each series' labels must be empty or a valid label
+        //   list without braces (e.g. partition="3"), and every series must have distinct labels.
+        // Postconditions:
+        // - Returns the series in the Prometheus text exposition format: a counter family per counter, one for
+        //   rejections labelled by reason, and a summary (quantiles 0.5, 0.9, 0.99, 0.999 in seconds) per histogram.
+        //   Each family is described once however many series there are.
+        static string toPrometheus(const string& name, const vector<pair<string, StreamMetricsSnapshot>>& series);
+
+        // Postconditions:
+        // - text replaces the file at path atomically (written beside it, then renamed), so a collector reading
+        //   the file, such as node_exporter's textfile collector, never sees half of it.
+        // - Throws runtime_error if the file cannot be written.
+        static void writePrometheusFile(const string& path, const string& text);
+
+    private:
+        atomic<long long> appends;
+        atomic<long long> bytesAppended;
+        atomic<long long> reads;
+        atomic<long long> messagesRead;
+        atomic<long long> flushes;
+        atomic<long long> bytesFlushed;
+        atomic<long long> syncs;
+        atomic<long long> messagesSynced;
+        array<atomic<long long>, 3> rejections;
+        LatencyHistogram appendLatency;
+        LatencyHistogram readLatency;
+        LatencyHistogram flushLatency;
+        LatencyHistogram syncLatency;
+
+        StreamMetrics(const StreamMetrics& other);
+        StreamMetrics& operator=(const StreamMetrics& other);
+};
+
+// Implementation invariant:
+// - A value v >= SUB_BUCKETS with highest set bit e falls in bucket (e - SUB_BUCKET_BITS + 1) * SUB_BUCKETS plus the
+//   SUB_BUCKET_BITS bits below e; smaller values are their own bucket. Bucket indexes therefore grow with the value,
+//   and the last bucket ends at MAX_NANOSECONDS (about 137 seconds).
+// - Each histogram is BUCKET_COUNT 64-bit counters (about 2 KB), four per stream; StreamMetrics is aligned to a cache
+//   line so the metrics of partitions written by different threads never share one.
+// - rejections is indexed by the RejectReason value.
+
+#endif
@@ -0,0 +1,68 @@
+// Saxton Van Dalsen
+// 11/14/2024
+
+#ifndef STREAMPOLICIES_H
+#define STREAMPOLICIES_H
+
+#include <string_view>
+
+using namespace std;
+
+// The compile-time policies a BasicMsgStream is built from. Each is a struct of constants and static functions, so
+// the stream reads them without storing or calling through anything, and a check a policy switches off is not
+// compiled into the stream at all.
+//
+// A StoragePolicy provides:
+// - MAX_CAPACITY, the largest capacity of a Fixed stream, and MAX_GROWABLE_CAPACITY, that of a Growable stream.
+// A ValidationPolicy provides:
+// - MAX_STRING_LENGTH, the longest message the stream is built for (emplaceMessage's buffer is this long), and
+// - isValid(message), which appendMessage, appendBatch and ingestMessage call on every message.
+// A LimitPolicy provides:
+// - ENFORCED, whether the stream keeps an operation budget at all, and
+// - OPERATION_MULTIPLIER, the default lifetime budget as a multiple of the requested capacity.
+
+// Fixed streams of up to 200 messages; Growable streams of up to 2^30.
+struct StandardStorage
+{
+    static const int MAX_CAPACITY = 200;
+    static const int MAX_GROWABLE_CAPACITY = 1 << 30;
+};
+
+// Messages must be non-empty and at most MAX_STRING_LENGTH characters.
+struct LengthValidation
+{
+    static const int MAX_STRING_LENGTH = 150;
+
+    static bool isValid(string_view message)
+    {
+        return !message.empty() && message.length() <= static_cast<size_t>(MAX_STRING_LENGTH);
+    }
+};
+
+// Messages are not checked: the caller guarantees they are non-empty and at most MAX_STRING_LENGTH characters, for
+// instance because they were validated before reaching the stream.
+struct TrustedMessages
+{
+    static const int MAX_STRING_LENGTH = 150;
+
+    static bool isValid(string_view)
+    {
+        return true;
+    }
+};
+
+// A lifetime budget of twice the requested capacity, which setOperationBudget may replace.
+struct LifetimeLimit
+{
+    static const bool ENFORCED = true;
+    static const int OPERATION_MULTIPLIER = 2;
+};
+
+// No operation budget: operations are never counted or refused, and only an unlimited budget may be set.
+struct NoOperationLimit
+{
+    static const bool ENFORCED = false;
+    static const int OPERATION_MULTIPLIER = 0;
+};
+
+#endif